@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Vector3.h"
+
+class AABB
+{
+public:
+
+	Vector3 min;
+	Vector3 max;
+
+	AABB() {}
+
+	AABB(const Vector3& _min, const Vector3& _max) : min(_min), max(_max) {}
+
+	bool Overlaps(const AABB& o) const
+	{
+		return min.x <= o.max.x && max.x >= o.min.x &&
+			min.y <= o.max.y && max.y >= o.min.y &&
+			min.z <= o.max.z && max.z >= o.min.z;
+	}
+
+	bool Contains(const AABB& o) const
+	{
+		return min.x <= o.min.x && max.x >= o.max.x &&
+			min.y <= o.min.y && max.y >= o.max.y &&
+			min.z <= o.min.z && max.z >= o.max.z;
+	}
+
+	AABB Merge(const AABB& o) const
+	{
+		return AABB(
+			Vector3(min.x < o.min.x ? min.x : o.min.x,
+				min.y < o.min.y ? min.y : o.min.y,
+				min.z < o.min.z ? min.z : o.min.z),
+			Vector3(max.x > o.max.x ? max.x : o.max.x,
+				max.y > o.max.y ? max.y : o.max.y,
+				max.z > o.max.z ? max.z : o.max.z)
+		);
+	}
+
+	void Enlarge(real margin)
+	{
+		min -= Vector3(margin, margin, margin);
+		max += Vector3(margin, margin, margin);
+	}
+
+	Vector3 GetCenter() const
+	{
+		return (min + max) * (real)0.5;
+	}
+
+	Vector3 GetHalfSize() const
+	{
+		return (max - min) * (real)0.5;
+	}
+
+	real SurfaceArea() const
+	{
+		Vector3 d = max - min;
+		return (real)2 * (d.x * d.y + d.y * d.z + d.z * d.x);
+	}
+
+	friend std::ostream& operator<<(std::ostream& os, const AABB& b)
+	{
+		os << b.min << ' ' << b.max;
+		return os;
+	}
+};
@@ -0,0 +1,220 @@
+#pragma once
+#include "SphereBatch.h"
+
+
+// Boxes packed for testing many spheres against them (projectiles against crates). Each box is
+// one record of 16 reals: the 12 entries of its transform, its half size and one of padding.
+class BoxBatch
+{
+	std::vector<real> boxes;
+
+#if defined(SPHERE_BATCH_AVX)
+	static inline void Transpose(__m256d& r0, __m256d& r1, __m256d& r2, __m256d& r3)
+	{
+		__m256d t0 = _mm256_unpacklo_pd(r0, r1);
+		__m256d t1 = _mm256_unpackhi_pd(r0, r1);
+		__m256d t2 = _mm256_unpacklo_pd(r2, r3);
+		__m256d t3 = _mm256_unpackhi_pd(r2, r3);
+
+		r0 = _mm256_permute2f128_pd(t0, t2, 0x20);
+		r1 = _mm256_permute2f128_pd(t1, t3, 0x20);
+		r2 = _mm256_permute2f128_pd(t0, t2, 0x31);
+		r3 = _mm256_permute2f128_pd(t1, t3, 0x31);
+	}
+#endif
+
+public:
+
+	void Clear()
+	{
+		boxes.clear();
+	}
+
+	unsigned Size() const
+	{
+		return (unsigned)boxes.size() / 16;
+	}
+
+	// Returns the index of the box in the batch
+	unsigned Add(const Matrix4& transform, const Vector3& halfSize)
+	{
+		boxes.resize(boxes.size() + 16);
+		Set(Size() - 1, transform, halfSize);
+
+		return Size() - 1;
+	}
+
+	unsigned Add(const BoxCollider* box)
+	{
+		return Add(box->GetTransform(), box->halfSize);
+	}
+
+	void Set(unsigned index, const Matrix4& transform, const Vector3& halfSize)
+	{
+		real* box = &boxes[16 * index];
+
+		for (unsigned i = 0; i < 12; i++) box[i] = transform.data[i];
+		box[12] = halfSize.x;
+		box[13] = halfSize.y;
+		box[14] = halfSize.z;
+		box[15] = 0;
+	}
+
+	Matrix4 GetTransform(unsigned index) const
+	{
+		const real* box = &boxes[16 * index];
+		return Matrix4(box[0], box[1], box[2], box[3], box[4], box[5], box[6], box[7], box[8], box[9], box[10], box[11]);
+	}
+
+	Vector3 GetHalfSize(unsigned index) const
+	{
+		const real* box = &boxes[16 * index];
+		return Vector3(box[12], box[13], box[14]);
+	}
+
+	// Tests the candidate pairs (box[i], sphere[i]) and writes a contact for every pair that touches,
+	// packed at the front of contacts, which must have room for count entries. Returns the number
+	// of contacts. The reject tests and the clamp run on four pairs at once without branches, in the
+	// same operation order as the per pair routine, so exactly the same pairs are kept.
+	unsigned DetectCollisions(const SphereBatch& spheres, const unsigned* box, const unsigned* sphere, unsigned count, SphereContact* contacts) const
+	{
+		const real* boxData = boxes.empty() ? NULL : &boxes[0];
+		const real* sphereData = spheres.GetData();
+
+		unsigned hits = 0;
+		unsigned i = 0;
+
+#if defined(SPHERE_BATCH_AVX)
+
+		const __m256d signMask = _mm256_set1_pd(-0.0);
+
+		for (; i + 4 <= count; i += 4)
+		{
+			const real* b0 = boxData + 16 * box[i];
+			const real* b1 = boxData + 16 * box[i + 1];
+			const real* b2 = boxData + 16 * box[i + 2];
+			const real* b3 = boxData + 16 * box[i + 3];
+
+			// m[k] holds entry k of the four transforms, m[12..14] the half sizes
+			__m256d m[16];
+			for (unsigned row = 0; row < 4; row++)
+			{
+				m[4 * row] = _mm256_loadu_pd(b0 + 4 * row);
+				m[4 * row + 1] = _mm256_loadu_pd(b1 + 4 * row);
+				m[4 * row + 2] = _mm256_loadu_pd(b2 + 4 * row);
+				m[4 * row + 3] = _mm256_loadu_pd(b3 + 4 * row);
+				Transpose(m[4 * row], m[4 * row + 1], m[4 * row + 2], m[4 * row + 3]);
+			}
+
+			__m256d cx = _mm256_loadu_pd(sphereData + 4 * sphere[i]);
+			__m256d cy = _mm256_loadu_pd(sphereData + 4 * sphere[i + 1]);
+			__m256d cz = _mm256_loadu_pd(sphereData + 4 * sphere[i + 2]);
+			__m256d radius = _mm256_loadu_pd(sphereData + 4 * sphere[i + 3]);
+			Transpose(cx, cy, cz, radius);
+
+			// Matrix4::TransformInversePoint
+			__m256d tx = _mm256_sub_pd(cx, m[3]);
+			__m256d ty = _mm256_sub_pd(cy, m[7]);
+			__m256d tz = _mm256_sub_pd(cz, m[11]);
+
+			__m256d local[3];
+			for (unsigned k = 0; k < 3; k++)
+			{
+				local[k] = _mm256_add_pd(_mm256_add_pd(
+					_mm256_mul_pd(tx, m[k]),
+					_mm256_mul_pd(ty, m[k + 4])),
+					_mm256_mul_pd(tz, m[k + 8]));
+			}
+
+			__m256d rejected = _mm256_setzero_pd();
+			__m256d distance = _mm256_setzero_pd();
+
+			for (unsigned k = 0; k < 3; k++)
+			{
+				__m256d half = m[12 + k];
+
+				rejected = _mm256_or_pd(rejected, _mm256_cmp_pd(
+					_mm256_sub_pd(_mm256_andnot_pd(signMask, local[k]), radius), half, _CMP_GT_OQ));
+
+				// if (d > h) d = h; if (d < -h) d = -h;
+				__m256d clamped = _mm256_max_pd(_mm256_xor_pd(half, signMask), _mm256_min_pd(half, local[k]));
+
+				__m256d offset = _mm256_sub_pd(clamped, local[k]);
+				__m256d square = _mm256_mul_pd(offset, offset);
+				distance = k ? _mm256_add_pd(distance, square) : square;
+			}
+
+			rejected = _mm256_or_pd(rejected, _mm256_cmp_pd(distance, _mm256_mul_pd(radius, radius), _CMP_GT_OQ));
+
+			unsigned mask = (unsigned)_mm256_movemask_pd(rejected) ^ 0xf;
+
+			for (unsigned k = 0; mask; k++, mask >>= 1)
+			{
+				if (mask & 1) contacts[hits++].pair = i + k;
+			}
+		}
+
+#endif
+
+		for (; i < count; i++)
+		{
+			const real* b = boxData + 16 * box[i];
+			const real* s = sphereData + 4 * sphere[i];
+
+			real tx = s[0] - b[3], ty = s[1] - b[7], tz = s[2] - b[11];
+			real radius = s[3];
+
+			bool rejected = false;
+			real distance = 0;
+
+			for (unsigned k = 0; k < 3; k++)
+			{
+				real local = tx * b[k] + ty * b[k + 4] + tz * b[k + 8];
+				real half = b[12 + k];
+
+				if (real_abs(local) - radius > half) rejected = true;
+
+				real clamped = local;
+				if (clamped > half) clamped = half;
+				if (clamped < -half) clamped = -half;
+
+				distance += (clamped - local) * (clamped - local);
+			}
+
+			if (rejected || distance > radius * radius) continue;
+
+			contacts[hits++].pair = i;
+		}
+
+		// Fill in the contacts of the kept pairs only, exactly as the per pair routine does
+		for (unsigned h = 0; h < hits; h++)
+		{
+			unsigned pair = contacts[h].pair;
+
+			Matrix4 transform = GetTransform(box[pair]);
+			Vector3 halfSize = GetHalfSize(box[pair]);
+			Vector3 center = spheres.GetCentre(sphere[pair]);
+			real radius = spheres.GetRadius(sphere[pair]);
+
+			Vector3 realCenter = transform.TransformInversePoint(center);
+
+			Vector3 closestPt = realCenter;
+			for (unsigned k = 0; k < 3; k++)
+			{
+				if (closestPt[k] > halfSize[k]) closestPt[k] = halfSize[k];
+				if (closestPt[k] < -halfSize[k]) closestPt[k] = -halfSize[k];
+			}
+
+			real distance = (closestPt - realCenter).SquareMagnitude();
+			Vector3 closestPtWorld = transform.TransformPoint(closestPt);
+
+			SphereContact& contact = contacts[h];
+			contact.contactNormal = closestPtWorld - center;
+			contact.contactNormal.Normalise();
+			contact.contactPoint = closestPtWorld;
+			contact.penetration = radius - real_sqrt(distance);
+		}
+
+		return hits;
+	}
+};
@@ -0,0 +1,171 @@
+#pragma once
+#include "Colliders.h"
+#include "CollisionFilter.h"
+#include "Ray.h"
+#include "Overlap.h"
+#include <algorithm>
+
+
+enum BroadphaseType
+{
+BruteForce,
+SweepAndPrune,
+DynamicTree,
+UniformGrid
+};
+
+class ColliderPair
+{
+public:
+
+	Collider* one;
+	Collider* two;
+
+	ColliderPair() : one(NULL), two(NULL) {}
+
+	ColliderPair(Collider* _one, Collider* _two) : one(_one), two(_two) {}
+};
+
+class Broadphase
+{
+protected:
+
+	const CollisionFilter* filter = NULL;
+
+	// Every broadphase reports its pairs through here, so filtered pairs never reach the narrowphase
+	void AddPair(std::vector<ColliderPair>& pairs, Collider* one, Collider* two) const
+	{
+		if (filter && !filter->ShouldCollide(one, two)) return;
+
+		pairs.push_back(ColliderPair(one, two));
+	}
+
+	// Slab test against every collider in the list, for the broadphases without a hierarchy
+	static real QueryRayList(const std::vector<Collider*>& colliders, const Ray& ray, RayQueryCallback& callback)
+	{
+		Vector3 inverse = inverseDirection(ray.direction);
+		real maxDistance = ray.maxDistance;
+
+		for (unsigned i = 0; i < colliders.size(); i++)
+		{
+			real entry;
+			if (rayIntersectsBox(ray.origin, inverse, maxDistance, colliders[i]->GetBoundingBox(), ray.extent, entry))
+			{
+				maxDistance = callback.ReportCollider(colliders[i], maxDistance);
+			}
+		}
+
+		return maxDistance;
+	}
+
+	static bool QueryList(const std::vector<Collider*>& colliders, const AABB& box, OverlapCallback& callback)
+	{
+		for (unsigned i = 0; i < colliders.size(); i++)
+		{
+			if (colliders[i]->GetBoundingBox().Overlaps(box) && !callback.ReportCollider(colliders[i])) return false;
+		}
+
+		return true;
+	}
+
+	static real QueryNearestList(const std::vector<Collider*>& colliders, const Vector3& point, real maxDistance, NearestCallback& callback)
+	{
+		for (unsigned i = 0; i < colliders.size(); i++)
+		{
+			if (distanceToBox(point, colliders[i]->GetBoundingBox()) <= maxDistance)
+			{
+				maxDistance = callback.ReportCollider(colliders[i], maxDistance);
+			}
+		}
+
+		return maxDistance;
+	}
+
+public:
+
+	void SetFilter(const CollisionFilter* filter)
+	{
+		this->filter = filter;
+	}
+
+	virtual void Add(Collider* collider) = 0;
+	virtual void Remove(Collider* collider) = 0;
+
+	// Called once per step after every collider's bounding box has been refreshed
+	virtual void Update() = 0;
+
+	// Appends every candidate pair to the list, the list is not cleared
+	virtual void FindPairs(std::vector<ColliderPair>& pairs) = 0;
+
+	// Reports every collider whose bounding box the ray, or the box it sweeps, enters. Returns the
+	// distance the callback limited the ray to in the end.
+	virtual real QueryRay(const Ray& ray, RayQueryCallback& callback) = 0;
+
+	// Reports every collider whose bounding box overlaps the box until the callback returns false.
+	// Returns false when the callback ended the query.
+	virtual bool Query(const AABB& box, OverlapCallback& callback) = 0;
+
+	// Reports the colliders whose bounding boxes are within maxDistance of the point, returns the
+	// distance the callback limited the query to in the end
+	virtual real QueryNearest(const Vector3& point, real maxDistance, NearestCallback& callback) = 0;
+
+	virtual ~Broadphase()
+	{
+
+	}
+};
+
+
+// Reference mode, hands every pair to the narrowphase exactly like the original nested loop
+class BruteForceBroadphase : public Broadphase
+{
+	std::vector<Collider*> colliders;
+
+public:
+
+	void Add(Collider* collider)
+	{
+		collider->broadphaseProxy = (int)colliders.size();
+		colliders.push_back(collider);
+	}
+
+	void Remove(Collider* collider)
+	{
+		std::vector<Collider*>::iterator it = std::find(colliders.begin(), colliders.end(), collider);
+		if (it == colliders.end()) return;
+
+		colliders.erase(it);
+		collider->broadphaseProxy = -1;
+	}
+
+	void Update()
+	{
+
+	}
+
+	void FindPairs(std::vector<ColliderPair>& pairs)
+	{
+		for (unsigned i = 0; i < colliders.size(); i++)
+		{
+			for (unsigned j = i + 1; j < colliders.size(); j++)
+			{
+				AddPair(pairs, colliders[i], colliders[j]);
+			}
+		}
+	}
+
+	real QueryRay(const Ray& ray, RayQueryCallback& callback)
+	{
+		return QueryRayList(colliders, ray, callback);
+	}
+
+	bool Query(const AABB& box, OverlapCallback& callback)
+	{
+		return QueryList(colliders, box, callback);
+	}
+
+	real QueryNearest(const Vector3& point, real maxDistance, NearestCallback& callback)
+	{
+		return QueryNearestList(colliders, point, maxDistance, callback);
+	}
+};
@@ -1,18 +1,57 @@
 #pragma once
 #include "RigidBody.h"
+#include "AABB.h"
+#include "TriangleMesh.h"
+#include "DynamicAABBTree.h"
+#include <assert.h>
 
 
 enum ColliderType 
 {
 Box,
-Sphere
+Sphere,
+ConvexHull,
+Capsule,
+HalfSpace,
+TriangleMesh,
+Heightfield,
+Compound
+};
+
+// World space data of a collider, refreshed once per step. The world keeps these for all of its
+// colliders in one contiguous array.
+class ColliderState
+{
+public:
+
+	Matrix4 transform;
+	AABB boundingBox;
 };
 
 class Collider
 {
 protected:
 
-	Matrix4 transform;
+	// Used while the collider is not bound to a world's cache
+	ColliderState ownState;
+	ColliderState* state = &ownState;
+
+	virtual AABB CalculateBoundingBox(const Matrix4& transform) const = 0;
+
+	// World space box that contains a box given in the collider's space
+	static AABB TransformBox(const AABB& box, const Matrix4& transform)
+	{
+		const real* d = transform.data;
+		Vector3 center = transform.TransformPoint(box.GetCenter());
+		Vector3 half = box.GetHalfSize();
+		Vector3 extent(
+			half.x * real_abs(d[0]) + half.y * real_abs(d[1]) + half.z * real_abs(d[2]),
+			half.x * real_abs(d[4]) + half.y * real_abs(d[5]) + half.z * real_abs(d[6]),
+			half.x * real_abs(d[8]) + half.y * real_abs(d[9]) + half.z * real_abs(d[10])
+		);
+
+		return AABB(center - extent, center + extent);
+	}
 
 public:
 
@@ -20,19 +59,121 @@ public:
 	RigidBody * rigidBody;
 	Matrix4  offset;
 
+	// Pairs are only generated when each collider's group shares a bit with the other's mask
+	unsigned collisionGroup = 1;
+	unsigned collisionMask = 0xffffffff;
+
+	// Index into the world's layer collision matrix, below maxCollisionLayers
+	unsigned collisionLayer = 0;
+
+	// Handle owned by the world's broadphase, -1 while the collider is not registered
+	int broadphaseProxy = -1;
+
+	// Stable key the world gives the collider the first time it sees it, in the order colliders are
+	// added. Pairs are sorted and resolved by it so a scene steps the same way on every run.
+	unsigned id = 0xffffffff;
+
+	Collider()
+	{
+
+	}
+
+	// A copy is a new collider, it takes the source's world space data into its own storage and is
+	// not registered with any world
+	Collider(const Collider& other) :
+		ownState(*other.state), colliderType(other.colliderType), rigidBody(other.rigidBody), offset(other.offset),
+		collisionGroup(other.collisionGroup), collisionMask(other.collisionMask), collisionLayer(other.collisionLayer)
+	{
+
+	}
+
+	// Assignment keeps where the collider's data is stored and its registration with a world
+	Collider& operator=(const Collider& other)
+	{
+		if (this == &other) return *this;
+
+		*state = *other.state;
+		colliderType = other.colliderType;
+		rigidBody = other.rigidBody;
+		offset = other.offset;
+		collisionGroup = other.collisionGroup;
+		collisionMask = other.collisionMask;
+		collisionLayer = other.collisionLayer;
+		return *this;
+	}
+
 	const Matrix4& GetTransform() const
 	{
-		return transform;
+		return state->transform;
 	}
 
 	Vector3 GetAxis(unsigned index) const
 	{
-		return transform.GetAxisVector(index);
+		return state->transform.GetAxisVector(index);
+	}
+
+	const AABB& GetBoundingBox() const
+	{
+		return state->boundingBox;
+	}
+
+	// Support mapping used by GJK: the farthest point of the collider's core along direction, in
+	// world space. Rounded colliders return their core (the centre of a sphere) and report the
+	// rounding through GetMargin, which keeps GJK exact for them. Only convex colliders override this.
+	virtual Vector3 GetSupport(const Vector3&) const
+	{
+		return GetAxis(3);
+	}
+
+	virtual real GetMargin() const
+	{
+		return 0;
+	}
+
+	// Places the collider directly instead of through a body, e.g. the children of a compound
+	void SetTransform(const Matrix4& transform)
+	{
+		state->transform = transform;
+		state->boundingBox = CalculateBoundingBox(transform);
+	}
+
+	// Box in the collider's space that contains the given world space box
+	AABB ToLocalSpace(const AABB& box) const
+	{
+		const real* d = GetTransform().data;
+		Vector3 center = GetTransform().TransformInversePoint(box.GetCenter());
+		Vector3 half = box.GetHalfSize();
+		Vector3 extent(
+			half.x * real_abs(d[0]) + half.y * real_abs(d[4]) + half.z * real_abs(d[8]),
+			half.x * real_abs(d[1]) + half.y * real_abs(d[5]) + half.z * real_abs(d[9]),
+			half.x * real_abs(d[2]) + half.y * real_abs(d[6]) + half.z * real_abs(d[10])
+		);
+
+		return AABB(center - extent, center + extent);
+	}
+
+	// Moves the world space data into the given slot, NULL goes back to the collider's own storage
+	void BindState(ColliderState* cache)
+	{
+		ColliderState* target = cache ? cache : &ownState;
+		if (target == state) return;
+
+		*target = *state;
+		state = target;
 	}
 
 	void calculateInternals()
 	{
-		this->transform = rigidBody->GetTransform() * offset;
+		// Static geometry may have no body, its offset is then its place in the world
+		if (!rigidBody)
+			state->transform = offset;
+		// Most colliders sit at the origin of their body, skip the product for those
+		else if (offset.IsIdentity())
+			state->transform = rigidBody->GetTransform();
+		else
+			state->transform = rigidBody->GetTransform() * offset;
+
+		state->boundingBox = CalculateBoundingBox(state->transform);
 	}
 
 	virtual ~Collider()
@@ -53,6 +194,78 @@ public:
 	{
 		Collider::colliderType = ColliderType::Sphere;
 	}
+
+	Vector3 GetSupport(const Vector3&) const
+	{
+		return GetAxis(3);
+	}
+
+	real GetMargin() const
+	{
+		return radius;
+	}
+
+protected:
+
+	AABB CalculateBoundingBox(const Matrix4& transform) const
+	{
+		Vector3 center = transform.GetAxisVector(3);
+		Vector3 extent(radius, radius, radius);
+
+		return AABB(center - extent, center + extent);
+	}
+};
+
+
+// Sphere swept along the collider's local y axis from -halfHeight to halfHeight, for characters
+// and limbs that would otherwise be chains of spheres
+class CapsuleCollider : public Collider
+{
+public:
+
+	real radius;
+	real halfHeight;
+
+	CapsuleCollider()
+	{
+		Collider::colliderType = ColliderType::Capsule;
+	}
+
+	// End points of the core segment in world space
+	void GetSegment(Vector3& start, Vector3& end) const
+	{
+		Vector3 center = GetAxis(3);
+		Vector3 axis = GetAxis(1) * halfHeight;
+
+		start = center - axis;
+		end = center + axis;
+	}
+
+	Vector3 GetSupport(const Vector3& direction) const
+	{
+		Vector3 axis = GetAxis(1) * halfHeight;
+		return axis * direction < 0 ? GetAxis(3) - axis : GetAxis(3) + axis;
+	}
+
+	real GetMargin() const
+	{
+		return radius;
+	}
+
+protected:
+
+	AABB CalculateBoundingBox(const Matrix4& transform) const
+	{
+		const real* d = transform.data;
+		Vector3 center(d[3], d[7], d[11]);
+		Vector3 extent(
+			halfHeight * real_abs(d[1]) + radius,
+			halfHeight * real_abs(d[5]) + radius,
+			halfHeight * real_abs(d[9]) + radius
+		);
+
+		return AABB(center - extent, center + extent);
+	}
 };
 
 
@@ -66,4 +279,528 @@ public:
 	{
 		Collider::colliderType = ColliderType::Box;
 	}
+
+	Vector3 GetSupport(const Vector3& direction) const
+	{
+		Vector3 local = GetTransform().TransformInverseDirection(direction);
+
+		Vector3 vertex(
+			local.x < 0 ? -halfSize.x : halfSize.x,
+			local.y < 0 ? -halfSize.y : halfSize.y,
+			local.z < 0 ? -halfSize.z : halfSize.z
+		);
+
+		return GetTransform().TransformPoint(vertex);
+	}
+
+protected:
+
+	AABB CalculateBoundingBox(const Matrix4& transform) const
+	{
+		const real* d = transform.data;
+		Vector3 center(d[3], d[7], d[11]);
+		Vector3 extent(
+			halfSize.x * real_abs(d[0]) + halfSize.y * real_abs(d[1]) + halfSize.z * real_abs(d[2]),
+			halfSize.x * real_abs(d[4]) + halfSize.y * real_abs(d[5]) + halfSize.z * real_abs(d[6]),
+			halfSize.x * real_abs(d[8]) + halfSize.y * real_abs(d[9]) + halfSize.z * real_abs(d[10])
+		);
+
+		return AABB(center - extent, center + extent);
+	}
+};
+
+
+// Convex hull of a set of points, for props that boxes and spheres only approximate.
+// Interior points are allowed, they are simply never returned by the support mapping.
+class ConvexHullCollider : public Collider
+{
+public:
+
+	// In the collider's space, placed in the world by the body and the offset like the other colliders
+	std::vector<Vector3> vertices;
+
+	ConvexHullCollider()
+	{
+		Collider::colliderType = ColliderType::ConvexHull;
+	}
+
+	Vector3 GetSupport(const Vector3& direction) const
+	{
+		assert(!vertices.empty());
+
+		Vector3 local = GetTransform().TransformInverseDirection(direction);
+
+		unsigned best = 0;
+		real bestDistance = vertices[0] * local;
+
+		for (unsigned i = 1; i < vertices.size(); i++)
+		{
+			real distance = vertices[i] * local;
+			if (distance > bestDistance)
+			{
+				bestDistance = distance;
+				best = i;
+			}
+		}
+
+		return GetTransform().TransformPoint(vertices[best]);
+	}
+
+protected:
+
+	AABB CalculateBoundingBox(const Matrix4& transform) const
+	{
+		if (vertices.empty())
+		{
+			Vector3 center = transform.GetAxisVector(3);
+			return AABB(center, center);
+		}
+
+		Vector3 point = transform.TransformPoint(vertices[0]);
+		AABB box(point, point);
+
+		for (unsigned i = 1; i < vertices.size(); i++)
+		{
+			point = transform.TransformPoint(vertices[i]);
+			box = box.Merge(AABB(point, point));
+		}
+
+		return box;
+	}
+};
+
+
+// Everything below a plane, for floors and walls. The plane is normal * p = distance in the collider's
+// space, normal must have unit length. Half spaces are unbounded and are kept out of the pair search:
+// they go into the world's halfSpaces list, which every movable collider is tested against directly.
+class HalfSpaceCollider : public Collider
+{
+public:
+
+	Vector3 normal;
+	real distance;
+
+	HalfSpaceCollider() : normal(0, 1, 0), distance(0)
+	{
+		Collider::colliderType = ColliderType::HalfSpace;
+	}
+
+	Vector3 GetWorldNormal() const
+	{
+		return GetTransform().TransformDirection(normal);
+	}
+
+	real GetWorldDistance() const
+	{
+		return distance + GetWorldNormal() * GetAxis(3);
+	}
+
+	// Whether any part of the box is below the plane
+	bool Overlaps(const AABB& box) const
+	{
+		Vector3 worldNormal = GetWorldNormal();
+		Vector3 half = box.GetHalfSize();
+
+		real radius = half.x * real_abs(worldNormal.x) + half.y * real_abs(worldNormal.y) + half.z * real_abs(worldNormal.z);
+
+		return worldNormal * box.GetCenter() - GetWorldDistance() < radius;
+	}
+
+protected:
+
+	AABB CalculateBoundingBox(const Matrix4&) const
+	{
+		return AABB(Vector3(-REAL_MAX, -REAL_MAX, -REAL_MAX), Vector3(REAL_MAX, REAL_MAX, REAL_MAX));
+	}
+};
+
+
+// Static level geometry. The triangles and their tree live in a TriangleMeshData, which can be
+// shared by several colliders and must outlive them.
+class TriangleMeshCollider : public Collider
+{
+public:
+
+	const TriangleMeshData* mesh;
+
+	// Scratch list for the triangle queries of the narrowphase, kept to reuse its storage
+	std::vector<unsigned> hits;
+
+	TriangleMeshCollider(const TriangleMeshData* mesh = NULL) : mesh(mesh)
+	{
+		Collider::colliderType = ColliderType::TriangleMesh;
+	}
+
+	// Adds the triangles that may overlap the box, given in the collider's space, to hits
+	void Query(const AABB& box, std::vector<unsigned>& hits) const
+	{
+		if (mesh) mesh->Query(box, hits);
+	}
+
+	void GetTriangle(unsigned index, Vector3& a, Vector3& b, Vector3& c) const
+	{
+		mesh->GetTriangle(index, a, b, c);
+	}
+
+	unsigned GetActiveEdges(unsigned index) const
+	{
+		return mesh->GetActiveEdges(index);
+	}
+
+	// Closest triangle hit by a ray in the collider's space
+	bool Raycast(const Vector3& origin, const Vector3& direction, real maxDistance, real& distance, unsigned& triangle) const
+	{
+		return mesh && mesh->Raycast(origin, direction, maxDistance, distance, triangle);
+	}
+
+protected:
+
+	AABB CalculateBoundingBox(const Matrix4& transform) const
+	{
+		if (!mesh || !mesh->GetTriangleCount())
+		{
+			Vector3 center = transform.GetAxisVector(3);
+			return AABB(center, center);
+		}
+
+		return TransformBox(mesh->GetBounds(), transform);
+	}
+};
+
+
+// Terrain given by a regular grid of heights. Sample (column, row) is at (column, height, row) * cellSize
+// in the collider's space, every cell is split into two triangles along the diagonal from
+// (column + 1, row) to (column, row + 1). Triangles only exist while a query asks for them.
+class HeightfieldCollider : public Collider
+{
+	unsigned columns;
+	unsigned rows;
+	real cellSize;
+
+	std::vector<float> heights;
+	float minHeight;
+	float maxHeight;
+
+	Vector3 GetPoint(unsigned column, unsigned row) const
+	{
+		return Vector3(column * cellSize, heights[row * columns + column], row * cellSize);
+	}
+
+public:
+
+	// Scratch list for the triangle queries of the narrowphase, kept to reuse its storage
+	std::vector<unsigned> hits;
+
+	HeightfieldCollider() : columns(0), rows(0), cellSize(1), minHeight(0), maxHeight(0)
+	{
+		Collider::colliderType = ColliderType::Heightfield;
+	}
+
+	// Copies columns * rows samples, stored row after row
+	void SetHeights(unsigned columns, unsigned rows, real cellSize, const float* samples)
+	{
+		this->columns = columns;
+		this->rows = rows;
+		this->cellSize = cellSize;
+
+		heights.assign(samples, samples + (size_t)columns * rows);
+
+		minHeight = maxHeight = heights.empty() ? 0 : heights[0];
+		for (size_t i = 1; i < heights.size(); i++)
+		{
+			if (heights[i] < minHeight) minHeight = heights[i];
+			if (heights[i] > maxHeight) maxHeight = heights[i];
+		}
+	}
+
+	unsigned GetColumns() const
+	{
+		return columns;
+	}
+
+	unsigned GetRows() const
+	{
+		return rows;
+	}
+
+	real GetCellSize() const
+	{
+		return cellSize;
+	}
+
+	real GetHeight(unsigned column, unsigned row) const
+	{
+		return heights[row * columns + column];
+	}
+
+	// Adds the triangles of the cells under the box, given in the collider's space, whose heights
+	// reach into it. Triangle 2 * cell and 2 * cell + 1 belong to cell = row * (columns - 1) + column.
+	void Query(const AABB& box, std::vector<unsigned>& hits) const
+	{
+		if (columns < 2 || rows < 2) return;
+		if (box.max.y < minHeight || box.min.y > maxHeight) return;
+
+		real inverse = (real)1 / cellSize;
+		real firstColumn = floor(box.min.x * inverse), lastColumn = floor(box.max.x * inverse);
+		real firstRow = floor(box.min.z * inverse), lastRow = floor(box.max.z * inverse);
+
+		if (lastColumn < 0 || lastRow < 0 || firstColumn > columns - 2 || firstRow > rows - 2) return;
+
+		unsigned columnStart = firstColumn < 0 ? 0 : (unsigned)firstColumn;
+		unsigned columnEnd = lastColumn > columns - 2 ? columns - 2 : (unsigned)lastColumn;
+		unsigned rowStart = firstRow < 0 ? 0 : (unsigned)firstRow;
+		unsigned rowEnd = lastRow > rows - 2 ? rows - 2 : (unsigned)lastRow;
+
+		for (unsigned row = rowStart; row <= rowEnd; row++)
+		{
+			const float* front = &heights[row * columns];
+			const float* back = front + columns;
+
+			for (unsigned column = columnStart; column <= columnEnd; column++)
+			{
+				float low = std::min(std::min(front[column], front[column + 1]), std::min(back[column], back[column + 1]));
+				float high = std::max(std::max(front[column], front[column + 1]), std::max(back[column], back[column + 1]));
+
+				if (high < box.min.y || low > box.max.y) continue;
+
+				unsigned cell = row * (columns - 1) + column;
+				hits.push_back(2 * cell);
+				hits.push_back(2 * cell + 1);
+			}
+		}
+	}
+
+	void GetTriangle(unsigned index, Vector3& a, Vector3& b, Vector3& c) const
+	{
+		unsigned cell = index / 2;
+		unsigned column = cell % (columns - 1), row = cell / (columns - 1);
+
+		if (index & 1)
+		{
+			a = GetPoint(column + 1, row);
+			b = GetPoint(column, row + 1);
+			c = GetPoint(column + 1, row + 1);
+		}
+		else
+		{
+			a = GetPoint(column, row);
+			b = GetPoint(column, row + 1);
+			c = GetPoint(column + 1, row);
+		}
+	}
+
+	// Closest triangle hit by a ray in the collider's space within maxDistance. The cells under the ray
+	// are walked in the order the ray crosses them, so the first cell with a hit holds the closest one.
+	bool Raycast(const Vector3& origin, const Vector3& direction, real maxDistance, real& distance, unsigned& triangle) const
+	{
+		if (columns < 2 || rows < 2) return false;
+
+		int lastColumn = (int)columns - 2, lastRow = (int)rows - 2;
+
+		AABB bounds(Vector3(0, minHeight, 0), Vector3((lastColumn + 1) * cellSize, maxHeight, (lastRow + 1) * cellSize));
+		real enter;
+		if (!rayIntersectsBox(origin, inverseDirection(direction), maxDistance, bounds, enter)) return false;
+
+		real inverse = (real)1 / cellSize;
+		Vector3 start = origin + direction * enter;
+		int column = std::max(0, std::min(lastColumn, (int)floor(start.x * inverse)));
+		int row = std::max(0, std::min(lastRow, (int)floor(start.z * inverse)));
+
+		// Distances along the ray to the next column and row boundaries and between two of them
+		int columnStep = direction.x > 0 ? 1 : -1;
+		int rowStep = direction.z > 0 ? 1 : -1;
+		real nextColumn = direction.x != 0 ? ((column + (columnStep > 0)) * cellSize - origin.x) / direction.x : REAL_MAX;
+		real nextRow = direction.z != 0 ? ((row + (rowStep > 0)) * cellSize - origin.z) / direction.z : REAL_MAX;
+		real columnDelta = direction.x != 0 ? cellSize / real_abs(direction.x) : REAL_MAX;
+		real rowDelta = direction.z != 0 ? cellSize / real_abs(direction.z) : REAL_MAX;
+
+		bool found = false;
+
+		while (true)
+		{
+			unsigned cell = row * (columns - 1) + column;
+
+			for (unsigned index = 2 * cell; index < 2 * cell + 2; index++)
+			{
+				Vector3 a, b, c;
+				real t;
+
+				GetTriangle(index, a, b, c);
+				if (rayIntersectsTriangle(origin, direction, maxDistance, a, b, c, t))
+				{
+					maxDistance = t;
+					distance = t;
+					triangle = index;
+					found = true;
+				}
+			}
+
+			real next = std::min(nextColumn, nextRow);
+			if (found || next > maxDistance || next >= REAL_MAX) return found;
+
+			if (nextColumn < nextRow)
+			{
+				column += columnStep;
+				nextColumn += columnDelta;
+			}
+			else
+			{
+				row += rowStep;
+				nextRow += rowDelta;
+			}
+
+			if (column < 0 || column > lastColumn || row < 0 || row > lastRow) return false;
+		}
+	}
+
+	// Same bits as TriangleMeshData::GetActiveEdges, found from the neighbouring samples
+	unsigned GetActiveEdges(unsigned index) const
+	{
+		unsigned cell = index / 2;
+		unsigned column = cell % (columns - 1), row = cell / (columns - 1);
+
+		Vector3 triangle[3];
+		GetTriangle(index, triangle[0], triangle[1], triangle[2]);
+
+		// Far vertex of the neighbour across each edge, missing on the border of the grid
+		bool inside[3];
+		Vector3 opposite[3];
+
+		if (index & 1)
+		{
+			inside[0] = true;
+			opposite[0] = GetPoint(column, row);
+			inside[1] = row + 2 < rows;
+			if (inside[1]) opposite[1] = GetPoint(column, row + 2);
+			inside[2] = column + 2 < columns;
+			if (inside[2]) opposite[2] = GetPoint(column + 2, row);
+		}
+		else
+		{
+			inside[0] = column > 0;
+			if (inside[0]) opposite[0] = GetPoint(column - 1, row + 1);
+			inside[1] = true;
+			opposite[1] = GetPoint(column + 1, row + 1);
+			inside[2] = row > 0;
+			if (inside[2]) opposite[2] = GetPoint(column + 1, row - 1);
+		}
+
+		unsigned active = 0;
+		for (unsigned j = 0; j < 3; j++)
+		{
+			if (!inside[j] || isActiveEdge(triangle, j, opposite[j])) active |= 1 << j;
+		}
+
+		return active;
+	}
+
+protected:
+
+	AABB CalculateBoundingBox(const Matrix4& transform) const
+	{
+		Vector3 extent(columns ? (columns - 1) * cellSize : 0, 0, rows ? (rows - 1) * cellSize : 0);
+
+		return TransformBox(AABB(Vector3(0, minHeight, 0), Vector3(extent.x, maxHeight, extent.z)), transform);
+	}
+};
+
+
+// Several shapes moving with one body, e.g. a vehicle built from boxes. The children are placed by
+// their offsets in the compound's space and kept in a small tree there, so the compound is a single
+// entry in the broadphase and a pair only places and tests the children near the other collider.
+// Children are owned by the compound, their own bodies are replaced by the compound's.
+class CompoundCollider : public Collider
+{
+	std::vector<Collider*> children;
+	DynamicAABBTree tree;
+	AABB localBounds;
+
+public:
+
+	// Scratch list for the tree queries of the narrowphase, kept to reuse its storage
+	std::vector<int> hits;
+
+	CompoundCollider() : tree((real)0)
+	{
+		Collider::colliderType = ColliderType::Compound;
+	}
+
+	// The children are owned, a copy would delete them a second time
+	CompoundCollider(const CompoundCollider&) = delete;
+	CompoundCollider& operator=(const CompoundCollider&) = delete;
+
+	void AddChild(Collider* child)
+	{
+		child->SetTransform(child->offset);
+
+		const AABB& box = child->GetBoundingBox();
+		localBounds = children.empty() ? box : localBounds.Merge(box);
+
+		tree.CreateProxy(box, child);
+		children.push_back(child);
+	}
+
+	unsigned GetChildCount() const
+	{
+		return (unsigned)children.size();
+	}
+
+	Collider* GetChild(unsigned index) const
+	{
+		return children[index];
+	}
+
+	// Bounds of all children in the compound's space
+	const AABB& GetLocalBounds() const
+	{
+		return localBounds;
+	}
+
+	// Adds the tree proxies of the children whose bounds overlap the box, in the compound's space, to hits
+	void Query(const AABB& box, std::vector<int>& hits)
+	{
+		tree.Query(box, hits);
+	}
+
+	// Calls callback(child, maxDistance) for the children whose bounds a ray in the compound's space enters
+	template<class Callback>
+	real QueryRay(const Ray& ray, Callback& callback)
+	{
+		return tree.QueryRay(ray, callback);
+	}
+
+	// Moves the child of a proxy to where the compound is now and returns it
+	Collider* PlaceChild(int proxy)
+	{
+		return PlaceChild(static_cast<Collider*>(tree.GetUserData(proxy)));
+	}
+
+	Collider* PlaceChild(Collider* child)
+	{
+		child->rigidBody = rigidBody;
+		child->SetTransform(GetTransform() * child->offset);
+
+		return child;
+	}
+
+	~CompoundCollider()
+	{
+		for (Collider* child : children)
+		{
+			delete child;
+		}
+	}
+
+protected:
+
+	AABB CalculateBoundingBox(const Matrix4& transform) const
+	{
+		if (children.empty())
+		{
+			Vector3 center = transform.GetAxisVector(3);
+			return AABB(center, center);
+		}
+
+		return TransformBox(localBounds, transform);
+	}
 };
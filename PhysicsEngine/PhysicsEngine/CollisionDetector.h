@@ -1,92 +1,248 @@
 #pragma once
 #include "Contact.h"
 #include "Colliders.h"
+#include "NarrowphaseCache.h"
+#include "SeparatingAxis.h"
+#include "GJK.h"
 #include <assert.h>
 
 
-static inline real transformToAxis(
-	const BoxCollider &box,
-	const Vector3 &axis
+static unsigned fillPointFaceBoxBox(
+	const BoxCollider &one,
+	const BoxCollider &two,
+	const Vector3 &toCentre,
+	unsigned best,
+	real pen,
+	ContactBuffer &contacts
 )
 {
-	return
-		box.halfSize.x * real_abs(axis * box.GetAxis(0)) +
-		box.halfSize.y * real_abs(axis * box.GetAxis(1)) +
-		box.halfSize.z * real_abs(axis * box.GetAxis(2));
+	Contact* contact = contacts.Allocate();
+
+	Vector3 normal = one.GetAxis(best);
+	if (one.GetAxis(best) * toCentre > 0)
+	{
+		normal = normal * -1.0f;
+	}
+
+	Vector3 vertex = two.halfSize;
+	if (two.GetAxis(0) * normal < 0) vertex.x = -vertex.x;
+	if (two.GetAxis(1) * normal < 0) vertex.y = -vertex.y;
+	if (two.GetAxis(2) * normal < 0) vertex.z = -vertex.z;
+
+	contact->contactNormal = normal;
+	contact->penetration = pen;
+	contact->contactPoint = two.GetTransform() * vertex;
+
+	contact->body[0] = one.rigidBody;
+	contact->body[1] = two.rigidBody;
+
+	//Material dependent, for now just set to constants
+	contact->friction = globalFriction;
+	contact->restitution = globalRestitution;
+
+	return 1;
 }
 
-static inline real penetrationOnAxis(
-	const BoxCollider &one,
-	const BoxCollider &two,
-	const Vector3 &axis,
-	const Vector3 &toCentre
+
+// Sutherland-Hodgman step, keeps the part of the polygon where plane * p <= offset
+static inline unsigned clipPolygon(
+	const Vector3 *in,
+	unsigned count,
+	const Vector3 &plane,
+	real offset,
+	Vector3 *out
 )
 {
-	real oneProject = transformToAxis(one, axis);
-	real twoProject = transformToAxis(two, axis);
+	unsigned outCount = 0;
+
+	for (unsigned i = 0; i < count; i++)
+	{
+		const Vector3 &a = in[i];
+		const Vector3 &b = in[(i + 1) % count];
+
+		real distanceA = plane * a - offset;
+		real distanceB = plane * b - offset;
 
-	real distance = real_abs(toCentre * axis);
+		if (distanceA <= 0) out[outCount++] = a;
+
+		if ((distanceA < 0 && distanceB > 0) || (distanceA > 0 && distanceB < 0))
+		{
+			out[outCount++] = a + (b - a) * (distanceA / (distanceA - distanceB));
+		}
+	}
 
-	return oneProject + twoProject - distance;
+	return outCount;
 }
 
-static inline bool tryAxis(
-	const BoxCollider &one,
-	const BoxCollider &two,
-	Vector3 axis,
-	const Vector3& toCentre,
-	unsigned index,
+// Picks at most four of the points: the deepest one, the one farthest from it and the two
+// spanning the largest area on either side of the line through them. Returns how many were chosen.
+static inline unsigned selectManifold(
+	const Vector3 *points,
+	const real *depths,
+	unsigned count,
+	const Vector3 &normal,
+	unsigned *chosen
+)
+{
+	unsigned candidates[4];
+
+	candidates[0] = 0;
+	for (unsigned i = 1; i < count; i++)
+	{
+		if (depths[i] > depths[candidates[0]]) candidates[0] = i;
+	}
+
+	candidates[1] = candidates[0];
+	real farthest = -1;
+	for (unsigned i = 0; i < count; i++)
+	{
+		real distance = (points[i] - points[candidates[0]]).SquareMagnitude();
+		if (distance > farthest) { farthest = distance; candidates[1] = i; }
+	}
 
-	real& smallestPenetration,
-	unsigned &smallestCase
+	Vector3 edge = points[candidates[1]] - points[candidates[0]];
+	real maxArea = 0, minArea = 0;
+	candidates[2] = candidates[3] = candidates[0];
+	for (unsigned i = 0; i < count; i++)
+	{
+		real area = (edge % (points[i] - points[candidates[0]])) * normal;
+		if (area > maxArea) { maxArea = area; candidates[2] = i; }
+		if (area < minArea) { minArea = area; candidates[3] = i; }
+	}
+
+	unsigned kept = 0;
+	for (unsigned i = 0; i < 4; i++)
+	{
+		bool duplicate = false;
+		for (unsigned j = 0; j < kept; j++) if (chosen[j] == candidates[i]) duplicate = true;
+		if (!duplicate) chosen[kept++] = candidates[i];
+	}
+
+	return kept;
+}
+
+// Keeps at most four of the clipped points, chosen by selectManifold
+static inline unsigned reduceManifold(
+	Vector3 *points,
+	real *depths,
+	unsigned count,
+	const Vector3 &normal
 )
 {
-	if (axis.SquareMagnitude() < 0.0001) return true;
-	axis.Normalise();
+	if (count <= 4) return count;
 
-	real penetration = penetrationOnAxis(one, two, axis, toCentre);
+	unsigned chosen[4];
+	unsigned kept = selectManifold(points, depths, count, normal, chosen);
 
-	if (penetration < 0) return false;
-	if (penetration < smallestPenetration) {
-		smallestPenetration = penetration;
-		smallestCase = index;
+	Vector3 keptPoints[4];
+	real keptDepths[4];
+	for (unsigned i = 0; i < kept; i++)
+	{
+		keptPoints[i] = points[chosen[i]];
+		keptDepths[i] = depths[chosen[i]];
 	}
-	return true;
+
+	for (unsigned i = 0; i < kept; i++)
+	{
+		points[i] = keptPoints[i];
+		depths[i] = keptDepths[i];
+	}
+
+	return kept;
 }
 
-static Contact* fillPointFaceBoxBox(
+// Face of box one against box two. The face of two most facing one is clipped against the side
+// planes of one's face, and every clipped point below that face becomes a contact.
+static unsigned fillFaceBoxBox(
 	const BoxCollider &one,
 	const BoxCollider &two,
 	const Vector3 &toCentre,
 	unsigned best,
-	real pen
+	real pen,
+	ContactBuffer &contacts
 )
 {
-	Contact* contact = new Contact();
-
 	Vector3 normal = one.GetAxis(best);
-	if (one.GetAxis(best) * toCentre > 0)
+	if (normal * toCentre > 0)
 	{
 		normal = normal * -1.0f;
 	}
 
-	Vector3 vertex = two.halfSize;
-	if (two.GetAxis(0) * normal < 0) vertex.x = -vertex.x;
-	if (two.GetAxis(1) * normal < 0) vertex.y = -vertex.y;
-	if (two.GetAxis(2) * normal < 0) vertex.z = -vertex.z;
+	Vector3 oneCentre = one.GetAxis(3);
+	Vector3 faceNormal = normal * -1.0f;
+	real faceOffset = faceNormal * oneCentre + one.halfSize[best];
 
-	contact->contactNormal = normal;
-	contact->penetration = pen;
-	contact->contactPoint = two.GetTransform() * vertex;
+	unsigned incident = 0;
+	real incidentDot = 0;
+	for (unsigned i = 0; i < 3; i++)
+	{
+		real d = real_abs(two.GetAxis(i) * normal);
+		if (d > incidentDot) { incidentDot = d; incident = i; }
+	}
 
-	contact->body[0] = one.rigidBody;
-	contact->body[1] = two.rigidBody;
+	Vector3 incidentAxis = two.GetAxis(incident);
+	real side = incidentAxis * normal > 0 ? two.halfSize[incident] : -two.halfSize[incident];
+	Vector3 incidentCentre = two.GetAxis(3) + incidentAxis * side;
 
-	//Material dependent, for now just set to constants
-	contact->friction = globalFriction;
-	contact->restitution = globalRestitution;
+	unsigned a = (incident + 1) % 3;
+	unsigned b = (incident + 2) % 3;
+	Vector3 edgeA = two.GetAxis(a) * two.halfSize[a];
+	Vector3 edgeB = two.GetAxis(b) * two.halfSize[b];
+
+	Vector3 polygon[8], clipped[8];
+	polygon[0] = incidentCentre + edgeA + edgeB;
+	polygon[1] = incidentCentre - edgeA + edgeB;
+	polygon[2] = incidentCentre - edgeA - edgeB;
+	polygon[3] = incidentCentre + edgeA - edgeB;
+	unsigned count = 4;
+
+	for (unsigned i = 1; i < 3 && count > 0; i++)
+	{
+		unsigned sideIndex = (best + i) % 3;
+		Vector3 sideAxis = one.GetAxis(sideIndex);
+		real sideOffset = sideAxis * oneCentre;
+
+		count = clipPolygon(polygon, count, sideAxis, sideOffset + one.halfSize[sideIndex], clipped);
+		count = clipPolygon(clipped, count, sideAxis * -1.0f, -sideOffset + one.halfSize[sideIndex], polygon);
+	}
+
+	Vector3 points[8];
+	real depths[8];
+	unsigned found = 0;
+	for (unsigned i = 0; i < count; i++)
+	{
+		real depth = faceOffset - faceNormal * polygon[i];
+		if (depth < 0) continue;
+
+		points[found] = polygon[i];
+		depths[found] = depth;
+		found++;
+	}
+
+	if (found == 0)
+	{
+		return fillPointFaceBoxBox(one, two, toCentre, best, pen, contacts);
+	}
+
+	found = reduceManifold(points, depths, found, normal);
+
+	for (unsigned i = 0; i < found; i++)
+	{
+		Contact* contact = contacts.Allocate();
+
+		contact->contactNormal = normal;
+		contact->penetration = depths[i];
+		contact->contactPoint = points[i];
+
+		contact->body[0] = one.rigidBody;
+		contact->body[1] = two.rigidBody;
 
-	return contact;
+		//Material dependent, for now just set to constants
+		contact->friction = globalFriction;
+		contact->restitution = globalRestitution;
+	}
+
+	return found;
 }
 
 
@@ -137,206 +293,1662 @@ static inline Vector3 contactPoint(
 }
 
 
-class CollisionDetector
+// Parameter in [0, 1] of the point of the segment start + t * (end - start) closest to point
+static inline real closestOnSegment(const Vector3 &point, const Vector3 &start, const Vector3 &end)
 {
-public:
-	static Contact* DetectCollision(Collider* one, Collider* two)
+	Vector3 direction = end - start;
+	real length = direction.SquareMagnitude();
+
+	if (length <= 0) return 0;
+
+	real t = ((point - start) * direction) / length;
+	return t < 0 ? 0 : (t > 1 ? 1 : t);
+}
+
+// Parameters s and t in [0, 1] of the closest points of the segments startOne + s * (endOne - startOne)
+// and startTwo + t * (endTwo - startTwo). Parallel segments get s = 0 or the closest end instead.
+static inline void closestBetweenSegments(
+	const Vector3 &startOne,
+	const Vector3 &endOne,
+	const Vector3 &startTwo,
+	const Vector3 &endTwo,
+	real &s,
+	real &t
+)
+{
+	Vector3 dOne = endOne - startOne;
+	Vector3 dTwo = endTwo - startTwo;
+	Vector3 r = startOne - startTwo;
+
+	real a = dOne * dOne;
+	real e = dTwo * dTwo;
+	real f = dTwo * r;
+
+	if (a <= 0 && e <= 0)
 	{
-		
-		if (one->colliderType == ColliderType::Sphere && two->colliderType == ColliderType::Sphere)
-		{
-			return SphereAndSphere(dynamic_cast<SphereCollider*>(one), dynamic_cast<SphereCollider*>(two));
-		}
-		else if (one->colliderType == ColliderType::Box && two->colliderType == ColliderType::Sphere)
-		{
-			return BoxAndSphere(dynamic_cast<BoxCollider*>(one), dynamic_cast<SphereCollider*>(two));
-		}
-		else if (one->colliderType == ColliderType::Sphere && two->colliderType == ColliderType::Box)
-		{
-			return BoxAndSphere(dynamic_cast<BoxCollider*>(two), dynamic_cast<SphereCollider*>(one));
-		}
-		else if (one->colliderType == ColliderType::Box && two->colliderType == ColliderType::Box)
-		{
-			return BoxAndBox(dynamic_cast<BoxCollider*>(one), dynamic_cast<BoxCollider*>(two));
-		}
-		else
-		{
-			return NULL;
-		}
+		s = t = 0;
+		return;
+	}
 
+	if (a <= 0)
+	{
+		s = 0;
+		t = f / e;
+		t = t < 0 ? 0 : (t > 1 ? 1 : t);
+		return;
 	}
 
-private:
+	real c = dOne * r;
 
-	static Contact* SphereAndSphere(SphereCollider* one,SphereCollider* two)
+	if (e <= 0)
 	{
-		
-		
-		Vector3 positionOne = one->GetAxis(3);
-		Vector3 positionTwo = two->GetAxis(3);
+		t = 0;
+		s = -c / a;
+		s = s < 0 ? 0 : (s > 1 ? 1 : s);
+		return;
+	}
 
-		Vector3 midline = positionOne - positionTwo;
-		real size = midline.Magnitude();
+	real b = dOne * dTwo;
+	real denom = a * e - b * b;
 
-		if (size <= 0.0f || size >= (one->radius + two->radius))
-			return NULL;
+	s = denom > 0 ? (b * f - c * e) / denom : 0;
+	s = s < 0 ? 0 : (s > 1 ? 1 : s);
 
+	t = (b * s + f) / e;
 
-		Vector3 normal = midline * ((real)1/size);
+	if (t < 0)
+	{
+		t = 0;
+		s = -c / a;
+		s = s < 0 ? 0 : (s > 1 ? 1 : s);
+	}
+	else if (t > 1)
+	{
+		t = 1;
+		s = (b - c) / a;
+		s = s < 0 ? 0 : (s > 1 ? 1 : s);
+	}
+}
 
-		Contact * contact = new Contact();
+// Contact between two rounded cores, the points closest to each other on the cores of the colliders.
+// Like two spheres, the normal points from the second towards the first.
+static inline unsigned fillRoundedContact(
+	const Collider &one,
+	const Collider &two,
+	const Vector3 &coreOne,
+	const Vector3 &coreTwo,
+	real radiusOne,
+	real radiusTwo,
+	ContactBuffer &contacts
+)
+{
+	Vector3 midline = coreOne - coreTwo;
+	real size = midline.Magnitude();
 
-		contact->contactNormal = normal;
-		contact->contactPoint = positionOne + midline * (real)0.5;
-		contact->penetration = (one->radius + two->radius - size);
-		contact->body[0] = one->rigidBody;
-		contact->body[1] = two->rigidBody;
+	if (size <= 0 || size >= radiusOne + radiusTwo)
+		return 0;
 
-		//Material dependent, for now just set to constants
-		contact->friction = globalFriction;
-		contact->restitution = globalRestitution;
+	Vector3 normal = midline * ((real)1 / size);
 
-		return contact;
-	}
+	Contact* contact = contacts.Allocate();
 
-	static Contact* BoxAndSphere(BoxCollider* box, SphereCollider* sphere)
-	{
-		Vector3 center = sphere->GetAxis(3);
-		Vector3 realCenter = box->GetTransform().TransformInversePoint(center);
+	contact->contactNormal = normal;
+	contact->contactPoint = coreTwo + normal * ((size + radiusTwo - radiusOne) * (real)0.5);
+	contact->penetration = radiusOne + radiusTwo - size;
+	contact->body[0] = one.rigidBody;
+	contact->body[1] = two.rigidBody;
 
-		if (real_abs(realCenter.x) - sphere->radius > box->halfSize.x ||
-			real_abs(realCenter.y) - sphere->radius > box->halfSize.y ||
-			real_abs(realCenter.z) - sphere->radius > box->halfSize.z)
+	//Material dependent, for now just set to constants
+	contact->friction = globalFriction;
+	contact->restitution = globalRestitution;
+
+	return 1;
+}
+
+// Whether the segment crosses the box, both given in the box's space
+static inline bool segmentOverlapsBox(const Vector3 &start, const Vector3 &end, const Vector3 &halfSize)
+{
+	real enter = 0, leave = 1;
+	Vector3 direction = end - start;
+
+	for (unsigned i = 0; i < 3; i++)
+	{
+		if (real_abs(direction[i]) <= 0)
 		{
-			return NULL;
+			if (real_abs(start[i]) > halfSize[i]) return false;
+			continue;
 		}
 
-		Vector3 closestPt(0, 0, 0);
-		real dist;
+		real inverse = (real)1 / direction[i];
+		real low = (-halfSize[i] - start[i]) * inverse;
+		real high = (halfSize[i] - start[i]) * inverse;
+		if (low > high) std::swap(low, high);
 
-		dist = realCenter.x;
-		if (dist > box->halfSize.x) dist = box->halfSize.x;
-		if (dist < -box->halfSize.x) dist = -box->halfSize.x;
-		closestPt.x = dist;
+		if (low > enter) enter = low;
+		if (high < leave) leave = high;
+		if (enter > leave) return false;
+	}
 
-		dist = realCenter.y;
-		if (dist > box->halfSize.y) dist = box->halfSize.y;
-		if (dist < -box->halfSize.y) dist = -box->halfSize.y;
-		closestPt.y = dist;
+	return true;
+}
 
-		dist = realCenter.z;
-		if (dist > box->halfSize.z) dist = box->halfSize.z;
-		if (dist < -box->halfSize.z) dist = -box->halfSize.z;
-		closestPt.z = dist;
+// Point of the box closest to point, both in the box's space
+static inline Vector3 clampToBox(const Vector3 &point, const Vector3 &halfSize)
+{
+	Vector3 clamped;
+	for (unsigned i = 0; i < 3; i++)
+	{
+		real value = point[i];
+		if (value > halfSize[i]) value = halfSize[i];
+		if (value < -halfSize[i]) value = -halfSize[i];
+		clamped[i] = value;
+	}
+	return clamped;
+}
 
-		dist = (closestPt - realCenter).SquareMagnitude();
-		if (dist > sphere->radius * sphere->radius) 
-			return NULL;
 
-		Vector3 closestPtWorld = box->GetTransform().TransformPoint(closestPt);
+#define maxHalfSpacePoints 16
 
-		Contact* contact = new Contact();
+// Turns the points of a collider found below a half space into at most four contacts
+static inline unsigned fillHalfSpaceContacts(
+	const Collider &collider,
+	const HalfSpaceCollider &halfSpace,
+	const Vector3 &normal,
+	Vector3 *points,
+	real *depths,
+	unsigned count,
+	ContactBuffer &contacts
+)
+{
+	count = reduceManifold(points, depths, count, normal);
 
-		contact->contactNormal = (closestPtWorld - center);
-		contact->contactNormal.Normalise();
-		contact->contactPoint = closestPtWorld;
-		contact->penetration = sphere->radius - real_sqrt(dist);
+	for (unsigned i = 0; i < count; i++)
+	{
+		Contact* contact = contacts.Allocate();
 
-		contact->body[0] = box->rigidBody;
-		contact->body[1] = sphere->rigidBody;
+		contact->contactNormal = normal;
+		contact->contactPoint = points[i];
+		contact->penetration = depths[i];
+
+		contact->body[0] = collider.rigidBody;
+		contact->body[1] = halfSpace.rigidBody;
 
 		//Material dependent, for now just set to constants
 		contact->friction = globalFriction;
 		contact->restitution = globalRestitution;
-
-		return contact;
 	}
 
-	static Contact* BoxAndBox(BoxCollider* one, BoxCollider* two)
-	{
-		Vector3 toCentre = two->GetAxis(3) - one->GetAxis(3);
+	return count;
+}
 
-		real pen = REAL_MAX;
-		unsigned best = 0xffffff;
 
-		if (!tryAxis(*one, *two, (one->GetAxis(0)), toCentre, (0), pen, best)) return NULL;
-		if (!tryAxis(*one, *two, (one->GetAxis(1)), toCentre, (1), pen, best)) return NULL;
-		if (!tryAxis(*one, *two, (one->GetAxis(2)), toCentre, (2), pen, best)) return NULL;
+// Point of the triangle closest to point, by the Voronoi region of the triangle the point is in
+static inline Vector3 closestOnTriangle(const Vector3 &point, const Vector3 &a, const Vector3 &b, const Vector3 &c)
+{
+	Vector3 ab = b - a, ac = c - a;
 
-		if (!tryAxis(*one, *two, (two->GetAxis(0)), toCentre, (3), pen, best)) return NULL;
-		if (!tryAxis(*one, *two, (two->GetAxis(1)), toCentre, (4), pen, best)) return NULL;
-		if (!tryAxis(*one, *two, (two->GetAxis(2)), toCentre, (5), pen, best)) return NULL;
+	Vector3 ap = point - a;
+	real d1 = ab * ap, d2 = ac * ap;
+	if (d1 <= 0 && d2 <= 0) return a;
 
-		unsigned bestSingleAxis = best;
+	Vector3 bp = point - b;
+	real d3 = ab * bp, d4 = ac * bp;
+	if (d3 >= 0 && d4 <= d3) return b;
 
-		if (!tryAxis(*one, *two, (one->GetAxis(0) % two->GetAxis(0)), toCentre, (6), pen, best)) return NULL;
-		if (!tryAxis(*one, *two, (one->GetAxis(0) % two->GetAxis(1)), toCentre, (7), pen, best)) return NULL;
-		if (!tryAxis(*one, *two, (one->GetAxis(0) % two->GetAxis(2)), toCentre, (8), pen, best)) return NULL;
-		if (!tryAxis(*one, *two, (one->GetAxis(1) % two->GetAxis(0)), toCentre, (9), pen, best)) return NULL;
-		if (!tryAxis(*one, *two, (one->GetAxis(1) % two->GetAxis(1)), toCentre, (10), pen, best)) return NULL;
-		if (!tryAxis(*one, *two, (one->GetAxis(1) % two->GetAxis(2)), toCentre, (11), pen, best)) return NULL;
-		if (!tryAxis(*one, *two, (one->GetAxis(2) % two->GetAxis(0)), toCentre, (12), pen, best)) return NULL;
-		if (!tryAxis(*one, *two, (one->GetAxis(2) % two->GetAxis(1)), toCentre, (13), pen, best)) return NULL;
-		if (!tryAxis(*one, *two, (one->GetAxis(2) % two->GetAxis(2)), toCentre, (14), pen, best)) return NULL;
+	real vc = d1 * d4 - d3 * d2;
+	if (vc <= 0 && d1 >= 0 && d3 <= 0) return a + ab * (d1 / (d1 - d3));
 
-		assert(best != 0xffffff);
+	Vector3 cp = point - c;
+	real d5 = ab * cp, d6 = ac * cp;
+	if (d6 >= 0 && d5 <= d6) return c;
 
-		if (best < 3)
-		{
-			return fillPointFaceBoxBox(*one, *two, toCentre, best, pen);
-		}
-		else if (best < 6)
-		{
-			return fillPointFaceBoxBox(*two, *one, toCentre*-1.0f, best - 3, pen);
-		}
-		else
-		{
-			best -= 6;
-			unsigned oneAxisIndex = best / 3;
-			unsigned twoAxisIndex = best % 3;
-			Vector3 oneAxis = one->GetAxis(oneAxisIndex);
-			Vector3 twoAxis = two->GetAxis(twoAxisIndex);
-			Vector3 axis = oneAxis % twoAxis;
-			axis.Normalise();
+	real vb = d5 * d2 - d1 * d6;
+	if (vb <= 0 && d2 >= 0 && d6 <= 0) return a + ac * (d2 / (d2 - d6));
 
-			if (axis * toCentre > 0) axis = axis * -1.0f;
+	real va = d3 * d6 - d5 * d4;
+	if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0) return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
 
-			Vector3 ptOnOneEdge = one->halfSize;
-			Vector3 ptOnTwoEdge = two->halfSize;
-			for (unsigned i = 0; i < 3; i++)
-			{
-				if (i == oneAxisIndex) ptOnOneEdge[i] = 0;
-				else if (one->GetAxis(i) * axis > 0) ptOnOneEdge[i] = -ptOnOneEdge[i];
+	real sum = va + vb + vc;
+	if (sum <= 0) return a;
 
-				if (i == twoAxisIndex) ptOnTwoEdge[i] = 0;
-				else if (two->GetAxis(i) * axis < 0) ptOnTwoEdge[i] = -ptOnTwoEdge[i];
-			}
+	return a + ab * (vb / sum) + ac * (vc / sum);
+}
 
-			ptOnOneEdge = one->GetTransform() * ptOnOneEdge;
-			ptOnTwoEdge = two->GetTransform() * ptOnTwoEdge;
+// Overlap of a box centred at the origin of its own space and a triangle along axis. The penetration
+// is the shorter of the moves of the box along the axis (sign 1) or against it (sign -1).
+static inline bool boxTrianglePenetration(
+	const Vector3 &axis,
+	const Vector3 &halfSize,
+	const Vector3 *triangle,
+	real &penetration,
+	real &sign
+)
+{
+	real radius = halfSize.x * real_abs(axis.x) + halfSize.y * real_abs(axis.y) + halfSize.z * real_abs(axis.z);
 
-			Vector3 vertex = contactPoint(
-				ptOnOneEdge, oneAxis, one->halfSize[oneAxisIndex],
-				ptOnTwoEdge, twoAxis, two->halfSize[twoAxisIndex],
-				bestSingleAxis > 2
-			);
+	real p0 = axis * triangle[0], p1 = axis * triangle[1], p2 = axis * triangle[2];
+	real low = std::min(p0, std::min(p1, p2));
+	real high = std::max(p0, std::max(p1, p2));
 
-			Contact* contact = new Contact();
+	if (low > radius || high < -radius) return false;
 
-			contact->penetration = pen;
-			contact->contactNormal = axis;
-			contact->contactPoint = vertex;
+	real along = high + radius;
+	real against = radius - low;
 
-			contact->body[0] = one->rigidBody;
-			contact->body[1] = two->rigidBody;
+	penetration = along < against ? along : against;
+	sign = along < against ? (real)1 : (real)-1;
+	return true;
+}
 
-			//Material dependent, for now just set to constants
-			contact->friction = globalFriction;
-			contact->restitution = globalRestitution;
+// Contacts of a box against a triangle, both in the box's space. The triangle's normal, the box's
+// faces and the cross products of their edges are tested, then the face of the shallowest axis is
+// clipped against the other shape as for two boxes. Writes at most four points with their depths and
+// the normal pointing from the triangle towards the box, and returns how many.
+// Inside a surface the neighbours continue the triangle, so only its active edges (bit j for the edge
+// from vertex j) may push the box sideways, otherwise the other axes only test for separation.
+static unsigned boxTriangleContacts(
+	const Vector3 &halfSize,
+	const Vector3 *triangle,
+	unsigned activeEdges,
+	Vector3 &normal,
+	Vector3 *points,
+	real *depths
+)
+{
+	Vector3 edges[3] = { triangle[1] - triangle[0], triangle[2] - triangle[1], triangle[0] - triangle[2] };
+
+	Vector3 face = edges[0] % edges[1];
+	if (face.SquareMagnitude() <= 0) return 0;
+	face.Normalise();
+
+	real best, pen, sign;
+	unsigned bestAxis = 0;
+
+	if (!boxTrianglePenetration(face, halfSize, triangle, best, sign)) return 0;
+	normal = face * sign;
+
+	for (unsigned k = 0; k < 3; k++)
+	{
+		Vector3 axis;
+		axis[k] = 1;
+
+		if (!boxTrianglePenetration(axis, halfSize, triangle, pen, sign)) return 0;
+		if (activeEdges && pen < best)
+		{
+			best = pen;
+			normal = axis * sign;
+			bestAxis = 1 + k;
+		}
+	}
+
+	for (unsigned i = 0; i < 3; i++)
+	{
+		for (unsigned j = 0; j < 3; j++)
+		{
+			Vector3 boxEdge;
+			boxEdge[i] = 1;
+
+			Vector3 axis = boxEdge % edges[j];
+			real length = axis.SquareMagnitude();
+			if (length <= (real)1e-12 * edges[j].SquareMagnitude()) continue;
+			axis = axis * ((real)1 / real_sqrt(length));
+
+			if (!boxTrianglePenetration(axis, halfSize, triangle, pen, sign)) return 0;
+
+			// Edges only win clearly, so resting faces do not flicker to an edge contact
+			if ((activeEdges & (1 << j)) && pen < best * (real)0.95)
+			{
+				best = pen;
+				normal = axis * sign;
+				bestAxis = 4 + 3 * i + j;
+			}
+		}
+	}
+
+	Vector3 polygon[8], clipped[8];
+	unsigned count = 0;
+
+	if (bestAxis == 0)
+	{
+		// The box face turned towards the triangle, clipped to the triangle's prism
+		unsigned k = real_abs(normal.x) > real_abs(normal.y) ? (real_abs(normal.x) > real_abs(normal.z) ? 0 : 2) : (real_abs(normal.y) > real_abs(normal.z) ? 1 : 2);
+		unsigned u = (k + 1) % 3, v = (k + 2) % 3;
+		real side = normal[k] > 0 ? -halfSize[k] : halfSize[k];
+
+		real signs[4][2] = { { 1, 1 }, { -1, 1 }, { -1, -1 }, { 1, -1 } };
+		for (unsigned c = 0; c < 4; c++)
+		{
+			polygon[c][k] = side;
+			polygon[c][u] = signs[c][0] * halfSize[u];
+			polygon[c][v] = signs[c][1] * halfSize[v];
+		}
+		count = 4;
+
+		for (unsigned j = 0; j < 3 && count; j++)
+		{
+			Vector3 plane = edges[j] % face;
+			count = clipPolygon(polygon, count, plane, plane * triangle[j], clipped);
+			for (unsigned c = 0; c < count; c++) polygon[c] = clipped[c];
+		}
+
+		real offset = normal * triangle[0];
+		unsigned kept = 0;
+		for (unsigned c = 0; c < count; c++)
+		{
+			real depth = offset - normal * polygon[c];
+			if (depth <= 0) continue;
+
+			points[kept] = polygon[c];
+			depths[kept] = depth;
+			kept++;
+		}
+		count = kept;
+	}
+	else if (bestAxis < 4)
+	{
+		// The triangle clipped to the sides of the box face turned towards it
+		unsigned k = bestAxis - 1;
+		unsigned u = (k + 1) % 3, v = (k + 2) % 3;
+		real direction = normal[k];
+
+		polygon[0] = triangle[0];
+		polygon[1] = triangle[1];
+		polygon[2] = triangle[2];
+		count = 3;
+
+		unsigned sides[2] = { u, v };
+		for (unsigned s = 0; s < 2 && count; s++)
+		{
+			Vector3 plane;
+
+			plane[sides[s]] = 1;
+			count = clipPolygon(polygon, count, plane, halfSize[sides[s]], clipped);
+			for (unsigned c = 0; c < count; c++) polygon[c] = clipped[c];
+
+			plane[sides[s]] = -1;
+			count = clipPolygon(polygon, count, plane, halfSize[sides[s]], clipped);
+			for (unsigned c = 0; c < count; c++) polygon[c] = clipped[c];
+		}
+
+		unsigned kept = 0;
+		for (unsigned c = 0; c < count; c++)
+		{
+			real depth = direction * polygon[c][k] + halfSize[k];
+			if (depth <= 0) continue;
+
+			points[kept] = polygon[c];
+			depths[kept] = depth;
+			kept++;
+		}
+		count = kept;
+	}
+	else
+	{
+		// Box edge against triangle edge, the box edge is the one nearest the triangle
+		unsigned i = (bestAxis - 4) / 3, j = (bestAxis - 4) % 3;
+
+		Vector3 start, end;
+		for (unsigned k = 0; k < 3; k++)
+		{
+			start[k] = end[k] = normal[k] > 0 ? -halfSize[k] : halfSize[k];
+		}
+		start[i] = -halfSize[i];
+		end[i] = halfSize[i];
+
+		real s, t;
+		closestBetweenSegments(start, end, triangle[j], triangle[j] + edges[j], s, t);
+
+		points[0] = (start + (end - start) * s + triangle[j] + edges[j] * t) * (real)0.5;
+		depths[0] = best;
+		return 1;
+	}
+
+	return reduceManifold(points, depths, count, normal);
+}
+
+#define maxMeshContacts 8
+
+// Slot for a contact against a triangle mesh, or NULL when the contact is not needed. Neighbouring
+// triangles report the same point along their shared edges, only the deepest of those is kept, and
+// once maxMeshContacts are found a deeper contact replaces the shallowest one.
+static inline Contact* allocateMeshContact(
+	ContactBuffer &contacts,
+	unsigned first,
+	unsigned &count,
+	const Vector3 &point,
+	real penetration
+)
+{
+	unsigned shallowest = first;
+	for (unsigned i = first; i < first + count; i++)
+	{
+		if ((contacts[i].contactPoint - point).SquareMagnitude() < (real)1e-12)
+		{
+			return contacts[i].penetration < penetration ? &contacts[i] : NULL;
+		}
+
+		if (contacts[i].penetration < contacts[shallowest].penetration) shallowest = i;
+	}
+
+	if (count < maxMeshContacts)
+	{
+		count++;
+		return contacts.Allocate();
+	}
+
+	return contacts[shallowest].penetration < penetration ? &contacts[shallowest] : NULL;
+}
+
+
+#define contactBreakingThreshold (real)0.02
+
+// GJK and EPA give a single point per step. The points of the last steps are kept in the pair's
+// cache in the space of each collider, so that resting contacts build up a manifold of up to four.
+// A kept point is dropped once the colliders separate there or slide apart along the normal.
+static void updatePersistentManifold(
+	const Collider &one,
+	const Collider &two,
+	const Vector3 &normal,
+	const Vector3 &pointOnOne,
+	const Vector3 &pointOnTwo,
+	NarrowphaseCache &cache
+)
+{
+	real threshold = contactBreakingThreshold;
+
+	unsigned kept = 0;
+	for (unsigned i = 0; i < cache.manifoldSize; i++)
+	{
+		const ManifoldPoint& point = cache.manifold[i];
+
+		Vector3 gap = one.GetTransform().TransformPoint(point.localOne) - two.GetTransform().TransformPoint(point.localTwo);
+		real depth = gap * normal;
+		Vector3 drift = gap - normal * depth;
+
+		if (depth < -threshold || drift.SquareMagnitude() > threshold * threshold) continue;
+
+		cache.manifold[kept++] = point;
+	}
+	cache.manifoldSize = kept;
+
+	ManifoldPoint added;
+	added.localOne = one.GetTransform().TransformInversePoint(pointOnOne);
+	added.localTwo = two.GetTransform().TransformInversePoint(pointOnTwo);
+
+	// A new point close to a kept one refreshes it instead
+	for (unsigned i = 0; i < cache.manifoldSize; i++)
+	{
+		Vector3 existing = one.GetTransform().TransformPoint(cache.manifold[i].localOne);
+		if ((existing - pointOnOne).SquareMagnitude() < threshold * threshold)
+		{
+			cache.manifold[i] = added;
+			return;
+		}
+	}
+
+	cache.manifold[cache.manifoldSize++] = added;
+	if (cache.manifoldSize <= maxManifoldPoints) return;
+
+	Vector3 points[maxManifoldPoints + 1];
+	real depths[maxManifoldPoints + 1];
+	for (unsigned i = 0; i < cache.manifoldSize; i++)
+	{
+		points[i] = one.GetTransform().TransformPoint(cache.manifold[i].localOne);
+		depths[i] = (points[i] - two.GetTransform().TransformPoint(cache.manifold[i].localTwo)) * normal;
+	}
+
+	unsigned chosen[4];
+	unsigned count = selectManifold(points, depths, cache.manifoldSize, normal, chosen);
+
+	ManifoldPoint selected[4];
+	for (unsigned i = 0; i < count; i++) selected[i] = cache.manifold[chosen[i]];
+	for (unsigned i = 0; i < count; i++) cache.manifold[i] = selected[i];
+	cache.manifoldSize = count;
+}
+
+
+#define maxColliderTypes 16
+
+typedef unsigned (*CollisionFunction)(Collider* one, Collider* two, ContactBuffer& contacts, NarrowphaseCache& cache);
+
+// Fills in the distance and normal of the hit, the caller fills in the rest
+typedef bool (*RaycastFunction)(Collider* collider, const Ray& ray, RaycastHit& hit);
+
+// Fills in the distance, normal and point of the hit, the caller fills in the collider
+typedef bool (*ShapeCastFunction)(Collider* shape, const Vector3& direction, real maxDistance, Collider* target, RaycastHit& hit);
+
+class CollisionDetector
+{
+	class DispatchEntry
+	{
+	public:
+
+		CollisionFunction function;
+
+		// Set for the mirrored entry of an asymmetric routine, the colliders are passed swapped
+		bool swap;
+	};
+
+	class DispatchTable
+	{
+	public:
+
+		DispatchEntry entries[maxColliderTypes][maxColliderTypes];
+		RaycastFunction rays[maxColliderTypes];
+		ShapeCastFunction casts[maxColliderTypes][maxColliderTypes];
+
+		DispatchTable()
+		{
+			for (unsigned i = 0; i < maxColliderTypes; i++)
+			{
+				rays[i] = NULL;
+
+				for (unsigned j = 0; j < maxColliderTypes; j++)
+				{
+					casts[i][j] = NULL;
+					entries[i][j].function = NULL;
+					entries[i][j].swap = false;
+				}
+			}
+
+			RegisterBuiltIns(*this);
+		}
+	};
+
+	static DispatchTable& GetDispatchTable()
+	{
+		static DispatchTable table;
+		return table;
+	}
+
+	static void Set(DispatchTable& table, ColliderType one, ColliderType two, CollisionFunction function)
+	{
+		assert(one < maxColliderTypes && two < maxColliderTypes);
+
+		table.entries[one][two].function = function;
+		table.entries[one][two].swap = false;
+
+		if (one != two)
+		{
+			table.entries[two][one].function = function;
+			table.entries[two][one].swap = true;
+		}
+	}
+
+	// Adapts a routine taking concrete collider types to the table's signature
+	template<class One, class Two, unsigned (*Routine)(One*, Two*, ContactBuffer&, NarrowphaseCache&)>
+	static unsigned Dispatch(Collider* one, Collider* two, ContactBuffer& contacts, NarrowphaseCache& cache)
+	{
+		return Routine(static_cast<One*>(one), static_cast<Two*>(two), contacts, cache);
+	}
+
+	template<class Shape, bool (*Routine)(Shape*, const Ray&, RaycastHit&)>
+	static bool DispatchRay(Collider* collider, const Ray& ray, RaycastHit& hit)
+	{
+		return Routine(static_cast<Shape*>(collider), ray, hit);
+	}
+
+	template<class Shape, class Target, bool (*Routine)(Shape*, const Vector3&, real, Target*, RaycastHit&)>
+	static bool DispatchCast(Collider* shape, const Vector3& direction, real maxDistance, Collider* target, RaycastHit& hit)
+	{
+		return Routine(static_cast<Shape*>(shape), direction, maxDistance, static_cast<Target*>(target), hit);
+	}
+
+	static void RegisterBuiltIns(DispatchTable& table)
+	{
+		Set(table, ColliderType::Sphere, ColliderType::Sphere, &Dispatch<SphereCollider, SphereCollider, &SphereAndSphere>);
+		Set(table, ColliderType::Box, ColliderType::Sphere, &Dispatch<BoxCollider, SphereCollider, &BoxAndSphere>);
+		Set(table, ColliderType::Box, ColliderType::Box, &Dispatch<BoxCollider, BoxCollider, &BoxAndBox>);
+
+		Set(table, ColliderType::ConvexHull, ColliderType::ConvexHull, &Dispatch<Collider, Collider, &ConvexAndConvex>);
+		Set(table, ColliderType::ConvexHull, ColliderType::Box, &Dispatch<Collider, Collider, &ConvexAndConvex>);
+		Set(table, ColliderType::ConvexHull, ColliderType::Sphere, &Dispatch<Collider, Collider, &ConvexAndConvex>);
+
+		Set(table, ColliderType::Capsule, ColliderType::Capsule, &Dispatch<CapsuleCollider, CapsuleCollider, &CapsuleAndCapsule>);
+		Set(table, ColliderType::Capsule, ColliderType::Sphere, &Dispatch<CapsuleCollider, SphereCollider, &CapsuleAndSphere>);
+		Set(table, ColliderType::Box, ColliderType::Capsule, &Dispatch<BoxCollider, CapsuleCollider, &BoxAndCapsule>);
+		Set(table, ColliderType::ConvexHull, ColliderType::Capsule, &Dispatch<Collider, Collider, &ConvexAndConvex>);
+
+		Set(table, ColliderType::Sphere, ColliderType::HalfSpace, &Dispatch<SphereCollider, HalfSpaceCollider, &SphereAndHalfSpace>);
+		Set(table, ColliderType::Box, ColliderType::HalfSpace, &Dispatch<BoxCollider, HalfSpaceCollider, &BoxAndHalfSpace>);
+		Set(table, ColliderType::Capsule, ColliderType::HalfSpace, &Dispatch<CapsuleCollider, HalfSpaceCollider, &CapsuleAndHalfSpace>);
+		Set(table, ColliderType::ConvexHull, ColliderType::HalfSpace, &Dispatch<ConvexHullCollider, HalfSpaceCollider, &ConvexAndHalfSpace>);
+
+		Set(table, ColliderType::Sphere, ColliderType::TriangleMesh, &Dispatch<SphereCollider, TriangleMeshCollider, &SphereAndTriangles<TriangleMeshCollider> >);
+		Set(table, ColliderType::Box, ColliderType::TriangleMesh, &Dispatch<BoxCollider, TriangleMeshCollider, &BoxAndTriangles<TriangleMeshCollider> >);
+		Set(table, ColliderType::Sphere, ColliderType::Heightfield, &Dispatch<SphereCollider, HeightfieldCollider, &SphereAndTriangles<HeightfieldCollider> >);
+		Set(table, ColliderType::Box, ColliderType::Heightfield, &Dispatch<BoxCollider, HeightfieldCollider, &BoxAndTriangles<HeightfieldCollider> >);
+
+		for (unsigned type = 0; type <= ColliderType::Compound; type++)
+		{
+			Set(table, ColliderType::Compound, (ColliderType)type, &Dispatch<CompoundCollider, Collider, &CompoundAndCollider>);
+		}
+
+		table.rays[ColliderType::Sphere] = &DispatchRay<SphereCollider, &SphereRay>;
+		table.rays[ColliderType::Box] = &DispatchRay<BoxCollider, &BoxRay>;
+		table.rays[ColliderType::ConvexHull] = &DispatchRay<Collider, &ConvexRay>;
+		table.rays[ColliderType::Capsule] = &DispatchRay<Collider, &ConvexRay>;
+		table.rays[ColliderType::HalfSpace] = &DispatchRay<HalfSpaceCollider, &HalfSpaceRay>;
+		table.rays[ColliderType::TriangleMesh] = &DispatchRay<TriangleMeshCollider, &TrianglesRay<TriangleMeshCollider> >;
+		table.rays[ColliderType::Heightfield] = &DispatchRay<HeightfieldCollider, &TrianglesRay<HeightfieldCollider> >;
+		table.rays[ColliderType::Compound] = &DispatchRay<CompoundCollider, &CompoundRay>;
+
+		const ColliderType convex[] = { ColliderType::Sphere, ColliderType::Box, ColliderType::Capsule, ColliderType::ConvexHull };
+
+		for (unsigned i = 0; i < 4; i++)
+		{
+			for (unsigned j = 0; j < 4; j++)
+			{
+				table.casts[convex[i]][convex[j]] = &DispatchCast<Collider, Collider, &ConvexCast>;
+			}
+
+			table.casts[convex[i]][ColliderType::HalfSpace] = &DispatchCast<Collider, HalfSpaceCollider, &ConvexAndHalfSpaceCast>;
+			table.casts[convex[i]][ColliderType::TriangleMesh] = &DispatchCast<Collider, TriangleMeshCollider, &ConvexAndTrianglesCast<TriangleMeshCollider> >;
+			table.casts[convex[i]][ColliderType::Heightfield] = &DispatchCast<Collider, HeightfieldCollider, &ConvexAndTrianglesCast<HeightfieldCollider> >;
+			table.casts[convex[i]][ColliderType::Compound] = &DispatchCast<Collider, CompoundCollider, &ConvexAndCompoundCast>;
+		}
+
+		table.casts[ColliderType::Sphere][ColliderType::Sphere] = &DispatchCast<SphereCollider, SphereCollider, &SphereAndSphereCast>;
+	}
+
+public:
+
+	// Installs the routine for colliders of type one against type two. The routine always receives
+	// them in that order, the reversed combination is dispatched with the arguments swapped.
+	static void Register(ColliderType one, ColliderType two, CollisionFunction function)
+	{
+		Set(GetDispatchTable(), one, two, function);
+	}
+
+	// Writes the contacts between the two colliders into the buffer and returns how many were written.
+	// The cache belongs to the pair and must always be passed with the colliders in the same order.
+	static unsigned DetectCollision(Collider* one, Collider* two, ContactBuffer& contacts, NarrowphaseCache& cache)
+	{
+		const DispatchEntry& entry = GetDispatchTable().entries[one->colliderType][two->colliderType];
+
+		if (!entry.function) return 0;
+
+		return entry.swap ? entry.function(two, one, contacts, cache) : entry.function(one, two, contacts, cache);
+	}
+
+	static unsigned DetectCollision(Collider* one, Collider* two, ContactBuffer& contacts)
+	{
+		NarrowphaseCache cache;
+		return DetectCollision(one, two, contacts, cache);
+	}
+
+	static void RegisterRaycast(ColliderType type, RaycastFunction function)
+	{
+		assert(type < maxColliderTypes);
+
+		GetDispatchTable().rays[type] = function;
+	}
+
+	// Whether the ray hits the collider within its maxDistance, the hit is only written when it does
+	static bool Raycast(Collider* collider, const Ray& ray, RaycastHit& hit)
+	{
+		RaycastFunction function = GetDispatchTable().rays[collider->colliderType];
+
+		RaycastHit result;
+		if (!function || !function(collider, ray, result)) return false;
+
+		result.collider = collider;
+		result.point = ray.origin + ray.direction * result.distance;
+		hit = result;
+		return true;
+	}
+
+	static void RegisterShapeCast(ColliderType shape, ColliderType target, ShapeCastFunction function)
+	{
+		assert(shape < maxColliderTypes && target < maxColliderTypes);
+
+		GetDispatchTable().casts[shape][target] = function;
+	}
+
+	// Whether colliders of type shape can be swept at all, either built in or registered
+	static bool CanShapeCast(ColliderType shape)
+	{
+		for (unsigned i = 0; i < maxColliderTypes; i++)
+		{
+			if (GetDispatchTable().casts[shape][i]) return true;
+		}
+
+		return false;
+	}
+
+	// Sweeps shape from where it is placed along direction, which must have unit length, and reports
+	// where it first touches target within maxDistance. The hit's point is on target and its normal
+	// points from target towards the shape. A shape that already touches target hits at distance 0.
+	static bool ShapeCast(Collider* shape, const Vector3& direction, real maxDistance, Collider* target, RaycastHit& hit)
+	{
+		ShapeCastFunction function = GetDispatchTable().casts[shape->colliderType][target->colliderType];
+
+		RaycastHit result;
+		if (!function || !function(shape, direction, maxDistance, target, result)) return false;
+
+		result.collider = target;
+		hit = result;
+		return true;
+	}
+
+private:
+
+	static unsigned SphereAndSphere(SphereCollider* one,SphereCollider* two, ContactBuffer& contacts, NarrowphaseCache&)
+	{
+		
+		
+		Vector3 positionOne = one->GetAxis(3);
+		Vector3 positionTwo = two->GetAxis(3);
+
+		Vector3 midline = positionOne - positionTwo;
+		real size = midline.Magnitude();
+
+		if (size <= 0.0f || size >= (one->radius + two->radius))
+			return 0;
+
+
+		Vector3 normal = midline * ((real)1/size);
+
+		Contact * contact = contacts.Allocate();
+
+		contact->contactNormal = normal;
+		contact->contactPoint = positionOne + midline * (real)0.5;
+		contact->penetration = (one->radius + two->radius - size);
+		contact->body[0] = one->rigidBody;
+		contact->body[1] = two->rigidBody;
+
+		//Material dependent, for now just set to constants
+		contact->friction = globalFriction;
+		contact->restitution = globalRestitution;
+
+		return 1;
+	}
+
+	static unsigned BoxAndSphere(BoxCollider* box, SphereCollider* sphere, ContactBuffer& contacts, NarrowphaseCache&)
+	{
+		Vector3 center = sphere->GetAxis(3);
+		Vector3 realCenter = box->GetTransform().TransformInversePoint(center);
+
+		if (real_abs(realCenter.x) - sphere->radius > box->halfSize.x ||
+			real_abs(realCenter.y) - sphere->radius > box->halfSize.y ||
+			real_abs(realCenter.z) - sphere->radius > box->halfSize.z)
+		{
+			return 0;
+		}
+
+		Vector3 closestPt(0, 0, 0);
+		real dist;
+
+		dist = realCenter.x;
+		if (dist > box->halfSize.x) dist = box->halfSize.x;
+		if (dist < -box->halfSize.x) dist = -box->halfSize.x;
+		closestPt.x = dist;
+
+		dist = realCenter.y;
+		if (dist > box->halfSize.y) dist = box->halfSize.y;
+		if (dist < -box->halfSize.y) dist = -box->halfSize.y;
+		closestPt.y = dist;
+
+		dist = realCenter.z;
+		if (dist > box->halfSize.z) dist = box->halfSize.z;
+		if (dist < -box->halfSize.z) dist = -box->halfSize.z;
+		closestPt.z = dist;
+
+		dist = (closestPt - realCenter).SquareMagnitude();
+		if (dist > sphere->radius * sphere->radius) 
+			return 0;
+
+		Vector3 closestPtWorld = box->GetTransform().TransformPoint(closestPt);
+
+		Contact* contact = contacts.Allocate();
+
+		contact->contactNormal = (closestPtWorld - center);
+		contact->contactNormal.Normalise();
+		contact->contactPoint = closestPtWorld;
+		contact->penetration = sphere->radius - real_sqrt(dist);
+
+		contact->body[0] = box->rigidBody;
+		contact->body[1] = sphere->rigidBody;
+
+		//Material dependent, for now just set to constants
+		contact->friction = globalFriction;
+		contact->restitution = globalRestitution;
+
+		return 1;
+	}
+
+	static unsigned BoxAndBox(BoxCollider* one, BoxCollider* two, ContactBuffer& contacts, NarrowphaseCache& cache)
+	{
+		Vector3 toCentre = two->GetAxis(3) - one->GetAxis(3);
+
+		real pen;
+		unsigned best, bestSingleAxis;
+
+		if (!boxBoxSeparatingAxes(*one, *two, toCentre, pen, best, bestSingleAxis, cache.boxAxis)) return 0;
+
+		assert(best != 0xffffff);
+
+		if (best < 3)
+		{
+			return fillFaceBoxBox(*one, *two, toCentre, best, pen, contacts);
+		}
+		else if (best < 6)
+		{
+			return fillFaceBoxBox(*two, *one, toCentre*-1.0f, best - 3, pen, contacts);
+		}
+		else
+		{
+			best -= 6;
+			unsigned oneAxisIndex = best / 3;
+			unsigned twoAxisIndex = best % 3;
+			Vector3 oneAxis = one->GetAxis(oneAxisIndex);
+			Vector3 twoAxis = two->GetAxis(twoAxisIndex);
+			Vector3 axis = oneAxis % twoAxis;
+			axis.Normalise();
+
+			if (axis * toCentre > 0) axis = axis * -1.0f;
+
+			Vector3 ptOnOneEdge = one->halfSize;
+			Vector3 ptOnTwoEdge = two->halfSize;
+			for (unsigned i = 0; i < 3; i++)
+			{
+				if (i == oneAxisIndex) ptOnOneEdge[i] = 0;
+				else if (one->GetAxis(i) * axis > 0) ptOnOneEdge[i] = -ptOnOneEdge[i];
+
+				if (i == twoAxisIndex) ptOnTwoEdge[i] = 0;
+				else if (two->GetAxis(i) * axis < 0) ptOnTwoEdge[i] = -ptOnTwoEdge[i];
+			}
+
+			ptOnOneEdge = one->GetTransform() * ptOnOneEdge;
+			ptOnTwoEdge = two->GetTransform() * ptOnTwoEdge;
+
+			Vector3 vertex = contactPoint(
+				ptOnOneEdge, oneAxis, one->halfSize[oneAxisIndex],
+				ptOnTwoEdge, twoAxis, two->halfSize[twoAxisIndex],
+				bestSingleAxis > 2
+			);
+
+			Contact* contact = contacts.Allocate();
+
+			contact->penetration = pen;
+			contact->contactNormal = axis;
+			contact->contactPoint = vertex;
+
+			contact->body[0] = one->rigidBody;
+			contact->body[1] = two->rigidBody;
+
+			//Material dependent, for now just set to constants
+			contact->friction = globalFriction;
+			contact->restitution = globalRestitution;
+
+			return 1;
+		}
+		return 0;
+	}
+
+	static unsigned CapsuleAndSphere(CapsuleCollider* capsule, SphereCollider* sphere, ContactBuffer& contacts, NarrowphaseCache&)
+	{
+		Vector3 start, end;
+		capsule->GetSegment(start, end);
+
+		Vector3 center = sphere->GetAxis(3);
+		real t = closestOnSegment(center, start, end);
+
+		return fillRoundedContact(*capsule, *sphere, start + (end - start) * t, center, capsule->radius, sphere->radius, contacts);
+	}
+
+	static unsigned CapsuleAndCapsule(CapsuleCollider* one, CapsuleCollider* two, ContactBuffer& contacts, NarrowphaseCache&)
+	{
+		Vector3 startOne, endOne, startTwo, endTwo;
+		one->GetSegment(startOne, endOne);
+		two->GetSegment(startTwo, endTwo);
+
+		Vector3 dOne = endOne - startOne;
+		Vector3 dTwo = endTwo - startTwo;
+		real lengthOne = dOne.SquareMagnitude();
+		real lengthTwo = dTwo.SquareMagnitude();
+
+		// Parallel capsules lying on each other touch along a line, one point would let them roll,
+		// so both ends of the overlap of the segments become contacts
+		if (lengthOne > 0 && lengthTwo > 0 && (dOne % dTwo).SquareMagnitude() <= (real)1e-6 * lengthOne * lengthTwo)
+		{
+			real low = ((startTwo - startOne) * dOne) / lengthOne;
+			real high = ((endTwo - startOne) * dOne) / lengthOne;
+			if (low > high) std::swap(low, high);
+			if (low < 0) low = 0;
+			if (high > 1) high = 1;
+
+			if (high > low)
+			{
+				unsigned count = 0;
+				real ends[2] = { low, high };
+
+				for (unsigned i = 0; i < 2; i++)
+				{
+					Vector3 pointOne = startOne + dOne * ends[i];
+					Vector3 pointTwo = startTwo + dTwo * closestOnSegment(pointOne, startTwo, endTwo);
+
+					count += fillRoundedContact(*one, *two, pointOne, pointTwo, one->radius, two->radius, contacts);
+				}
+
+				return count;
+			}
+		}
+
+		real s, t;
+		closestBetweenSegments(startOne, endOne, startTwo, endTwo, s, t);
+
+		return fillRoundedContact(*one, *two, startOne + dOne * s, startTwo + dTwo * t, one->radius, two->radius, contacts);
+	}
+
+	static unsigned BoxAndCapsule(BoxCollider* box, CapsuleCollider* capsule, ContactBuffer& contacts, NarrowphaseCache& cache)
+	{
+		Vector3 start, end;
+		capsule->GetSegment(start, end);
+
+		const Vector3& halfSize = box->halfSize;
+		Vector3 localStart = box->GetTransform().TransformInversePoint(start);
+		Vector3 localEnd = box->GetTransform().TransformInversePoint(end);
+
+		// The core inside the box has no closest points, the depth then comes from EPA
+		if (segmentOverlapsBox(localStart, localEnd, halfSize))
+		{
+			return ConvexAndConvex(box, capsule, contacts, cache);
+		}
+		cache.manifoldSize = 0;
+
+		// Outside the box the closest points are an end of the segment against the box,
+		// or the segment against one of the box's edges
+		Vector3 onSegment[14], onBox[14];
+		real distance[14];
+
+		onSegment[0] = localStart;
+		onSegment[1] = localEnd;
+
+		for (unsigned i = 0; i < 2; i++)
+		{
+			onBox[i] = clampToBox(onSegment[i], halfSize);
+			distance[i] = (onSegment[i] - onBox[i]).SquareMagnitude();
+		}
+
+		unsigned candidates = 2;
+		for (unsigned axis = 0; axis < 3; axis++)
+		{
+			for (unsigned corner = 0; corner < 4; corner++)
+			{
+				Vector3 edgeStart, edgeEnd;
+				unsigned u = (axis + 1) % 3, v = (axis + 2) % 3;
+
+				edgeStart[axis] = -halfSize[axis];
+				edgeEnd[axis] = halfSize[axis];
+				edgeStart[u] = edgeEnd[u] = (corner & 1) ? halfSize[u] : -halfSize[u];
+				edgeStart[v] = edgeEnd[v] = (corner & 2) ? halfSize[v] : -halfSize[v];
+
+				real s, t;
+				closestBetweenSegments(localStart, localEnd, edgeStart, edgeEnd, s, t);
+
+				onSegment[candidates] = localStart + (localEnd - localStart) * s;
+				onBox[candidates] = edgeStart + (edgeEnd - edgeStart) * t;
+				distance[candidates] = (onSegment[candidates] - onBox[candidates]).SquareMagnitude();
+				candidates++;
+			}
+		}
+
+		unsigned best = 0;
+		for (unsigned i = 1; i < candidates; i++)
+		{
+			if (distance[i] < distance[best]) best = i;
+		}
+
+		real radius = capsule->radius;
+		if (distance[best] >= radius * radius) return 0;
+
+		// A capsule lying on a face also rests on the far end of its segment
+		unsigned count = 0;
+		for (unsigned i = 0; i < candidates; i++)
+		{
+			if (i != best && (i > 1 || (onSegment[i] - onSegment[best]).SquareMagnitude() <= radius * radius * (real)1e-4)) continue;
+			if (distance[i] >= radius * radius || distance[i] <= 0) continue;
+
+			Vector3 center = box->GetTransform().TransformPoint(onSegment[i]);
+			Vector3 closest = box->GetTransform().TransformPoint(onBox[i]);
+
+			Contact* contact = contacts.Allocate();
+
+			contact->contactNormal = closest - center;
+			contact->contactNormal.Normalise();
+			contact->contactPoint = closest;
+			contact->penetration = radius - real_sqrt(distance[i]);
+
+			contact->body[0] = box->rigidBody;
+			contact->body[1] = capsule->rigidBody;
+
+			//Material dependent, for now just set to constants
+			contact->friction = globalFriction;
+			contact->restitution = globalRestitution;
 
-			return contact;
+			count++;
 		}
-		return NULL;
+
+		return count;
 	}
-};
 
+	static unsigned SphereAndHalfSpace(SphereCollider* sphere, HalfSpaceCollider* halfSpace, ContactBuffer& contacts, NarrowphaseCache&)
+	{
+		Vector3 normal = halfSpace->GetWorldNormal();
+		Vector3 center = sphere->GetAxis(3);
+
+		real distance = normal * center - halfSpace->GetWorldDistance();
+		if (distance >= sphere->radius) return 0;
+
+		Vector3 point = center - normal * distance;
+		real depth = sphere->radius - distance;
+
+		return fillHalfSpaceContacts(*sphere, *halfSpace, normal, &point, &depth, 1, contacts);
+	}
+
+	static unsigned BoxAndHalfSpace(BoxCollider* box, HalfSpaceCollider* halfSpace, ContactBuffer& contacts, NarrowphaseCache&)
+	{
+		Vector3 normal = halfSpace->GetWorldNormal();
+		real offset = halfSpace->GetWorldDistance();
+		const Vector3& half = box->halfSize;
+
+		real radius =
+			half.x * real_abs(box->GetAxis(0) * normal) +
+			half.y * real_abs(box->GetAxis(1) * normal) +
+			half.z * real_abs(box->GetAxis(2) * normal);
+
+		if (normal * box->GetAxis(3) - offset >= radius) return 0;
+
+		Vector3 points[8];
+		real depths[8];
+		unsigned count = 0;
+
+		for (unsigned i = 0; i < 8; i++)
+		{
+			Vector3 vertex(
+				(i & 1) ? half.x : -half.x,
+				(i & 2) ? half.y : -half.y,
+				(i & 4) ? half.z : -half.z
+			);
+			vertex = box->GetTransform().TransformPoint(vertex);
+
+			real distance = normal * vertex - offset;
+			if (distance >= 0) continue;
+
+			points[count] = vertex;
+			depths[count] = -distance;
+			count++;
+		}
+
+		return fillHalfSpaceContacts(*box, *halfSpace, normal, points, depths, count, contacts);
+	}
+
+	static unsigned CapsuleAndHalfSpace(CapsuleCollider* capsule, HalfSpaceCollider* halfSpace, ContactBuffer& contacts, NarrowphaseCache&)
+	{
+		Vector3 normal = halfSpace->GetWorldNormal();
+		real offset = halfSpace->GetWorldDistance();
+
+		Vector3 ends[2];
+		capsule->GetSegment(ends[0], ends[1]);
+
+		Vector3 points[2];
+		real depths[2];
+		unsigned count = 0;
+
+		for (unsigned i = 0; i < 2; i++)
+		{
+			real distance = normal * ends[i] - offset;
+			if (distance >= capsule->radius) continue;
+
+			points[count] = ends[i] - normal * capsule->radius;
+			depths[count] = capsule->radius - distance;
+			count++;
+		}
+
+		return fillHalfSpaceContacts(*capsule, *halfSpace, normal, points, depths, count, contacts);
+	}
+
+	static unsigned ConvexAndHalfSpace(ConvexHullCollider* hull, HalfSpaceCollider* halfSpace, ContactBuffer& contacts, NarrowphaseCache&)
+	{
+		Vector3 normal = halfSpace->GetWorldNormal();
+		real offset = halfSpace->GetWorldDistance();
+
+		if (hull->vertices.empty() || normal * hull->GetSupport(normal * -1) - offset >= 0) return 0;
+
+		// Large hulls are reduced on the way so the points fit a fixed buffer
+		Vector3 points[maxHalfSpacePoints];
+		real depths[maxHalfSpacePoints];
+		unsigned count = 0;
+
+		for (unsigned i = 0; i < hull->vertices.size(); i++)
+		{
+			Vector3 vertex = hull->GetTransform().TransformPoint(hull->vertices[i]);
+
+			real distance = normal * vertex - offset;
+			if (distance >= 0) continue;
+
+			if (count == maxHalfSpacePoints)
+			{
+				count = reduceManifold(points, depths, count, normal);
+			}
+
+			points[count] = vertex;
+			depths[count] = -distance;
+			count++;
+		}
+
+		return fillHalfSpaceContacts(*hull, *halfSpace, normal, points, depths, count, contacts);
+	}
+
+	// Sphere against the triangles of a mesh or heightfield, Triangles provides Query, GetTriangle
+	// and GetActiveEdges in its own space
+	template<class Triangles>
+	static unsigned SphereAndTriangles(SphereCollider* sphere, Triangles* mesh, ContactBuffer& contacts, NarrowphaseCache&)
+	{
+		real radius = sphere->radius;
+		Vector3 center = mesh->GetTransform().TransformInversePoint(sphere->GetAxis(3));
+
+		mesh->hits.clear();
+		mesh->Query(AABB(center - Vector3(radius, radius, radius), center + Vector3(radius, radius, radius)), mesh->hits);
+
+		unsigned first = contacts.Size();
+		unsigned count = 0;
+
+		for (unsigned h = 0; h < mesh->hits.size(); h++)
+		{
+			Vector3 a, b, c;
+			mesh->GetTriangle(mesh->hits[h], a, b, c);
+
+			Vector3 closest = closestOnTriangle(center, a, b, c);
+			Vector3 offset = center - closest;
+			real distance = offset.SquareMagnitude();
+
+			if (distance >= radius * radius) continue;
+			distance = real_sqrt(distance);
+
+			// A centre on the triangle is pushed out along the face
+			Vector3 normal = distance > 0 ? offset * ((real)1 / distance) : (b - a) % (c - a);
+			normal.Normalise();
+
+			Vector3 point = mesh->GetTransform().TransformPoint(closest);
+			Contact* contact = allocateMeshContact(contacts, first, count, point, radius - distance);
+			if (!contact) continue;
+
+			contact->contactNormal = mesh->GetTransform().TransformDirection(normal);
+			contact->contactPoint = point;
+			contact->penetration = radius - distance;
+
+			contact->body[0] = sphere->rigidBody;
+			contact->body[1] = mesh->rigidBody;
+
+			//Material dependent, for now just set to constants
+			contact->friction = globalFriction;
+			contact->restitution = globalRestitution;
+		}
+
+		return count;
+	}
+
+	template<class Triangles>
+	static unsigned BoxAndTriangles(BoxCollider* box, Triangles* mesh, ContactBuffer& contacts, NarrowphaseCache&)
+	{
+		mesh->hits.clear();
+		mesh->Query(mesh->ToLocalSpace(box->GetBoundingBox()), mesh->hits);
+
+		unsigned first = contacts.Size();
+		unsigned count = 0;
+
+		for (unsigned h = 0; h < mesh->hits.size(); h++)
+		{
+			Vector3 corners[3];
+			mesh->GetTriangle(mesh->hits[h], corners[0], corners[1], corners[2]);
+
+			Vector3 triangle[3];
+			for (unsigned k = 0; k < 3; k++)
+			{
+				triangle[k] = box->GetTransform().TransformInversePoint(mesh->GetTransform().TransformPoint(corners[k]));
+			}
+
+			Vector3 normal, points[8];
+			real depths[8];
+			unsigned found = boxTriangleContacts(box->halfSize, triangle, mesh->GetActiveEdges(mesh->hits[h]), normal, points, depths);
+			if (!found) continue;
+
+			normal = box->GetTransform().TransformDirection(normal);
+
+			for (unsigned i = 0; i < found; i++)
+			{
+				Vector3 point = box->GetTransform().TransformPoint(points[i]);
+				Contact* contact = allocateMeshContact(contacts, first, count, point, depths[i]);
+				if (!contact) continue;
+
+				contact->contactNormal = normal;
+				contact->contactPoint = point;
+				contact->penetration = depths[i];
+
+				contact->body[0] = box->rigidBody;
+				contact->body[1] = mesh->rigidBody;
+
+				//Material dependent, for now just set to constants
+				contact->friction = globalFriction;
+				contact->restitution = globalRestitution;
+			}
+		}
+
+		return count;
+	}
+
+	// Compound against any collider, another compound included. Only the children in the part of the
+	// compound's tree under the other collider are placed and tested. The pair's cache belongs to the
+	// compound as a whole, so the child pairs start from an empty cache every step.
+	static unsigned CompoundAndCollider(CompoundCollider* compound, Collider* other, ContactBuffer& contacts, NarrowphaseCache&)
+	{
+		compound->hits.clear();
+
+		// Half spaces are unbounded, every child is a candidate
+		if (other->colliderType == ColliderType::HalfSpace)
+			compound->Query(compound->GetLocalBounds(), compound->hits);
+		else
+			compound->Query(compound->ToLocalSpace(other->GetBoundingBox()), compound->hits);
+
+		unsigned count = 0;
+		for (unsigned h = 0; h < compound->hits.size(); h++)
+		{
+			Collider* child = compound->PlaceChild(compound->hits[h]);
+			if (!child->GetBoundingBox().Overlaps(other->GetBoundingBox())) continue;
+
+			NarrowphaseCache childCache;
+			count += DetectCollision(child, other, contacts, childCache);
+		}
+
+		return count;
+	}
+
+	// Any two convex colliders through their support mappings: GJK between the cores, EPA when
+	// the cores overlap, then the margins of rounded colliders are added back
+	static unsigned ConvexAndConvex(Collider* one, Collider* two, ContactBuffer& contacts, NarrowphaseCache& cache)
+	{
+		Simplex simplex;
+		GJKResult result;
+
+		real marginOne = one->GetMargin();
+		real marginTwo = two->GetMargin();
+
+		if (GJK::Distance(*one, *two, simplex, result, cache))
+		{
+			if (!EPA::Penetration(*one, *two, simplex, result)) return 0;
+		}
+		else if (result.distance >= marginOne + marginTwo)
+		{
+			cache.manifoldSize = 0;
+			return 0;
+		}
+
+		Vector3 surfaceOne = result.pointOnOne + result.normal * marginOne;
+		Vector3 surfaceTwo = result.pointOnTwo - result.normal * marginTwo;
+
+		updatePersistentManifold(*one, *two, result.normal, surfaceOne, surfaceTwo, cache);
+
+		unsigned count = 0;
+		for (unsigned i = 0; i < cache.manifoldSize; i++)
+		{
+			Vector3 pointOne = one->GetTransform().TransformPoint(cache.manifold[i].localOne);
+			Vector3 pointTwo = two->GetTransform().TransformPoint(cache.manifold[i].localTwo);
+
+			real penetration = (pointOne - pointTwo) * result.normal;
+			if (penetration <= 0) continue;
+
+			Contact* contact = contacts.Allocate();
+
+			contact->contactNormal = result.normal * -1;
+			contact->contactPoint = (pointOne + pointTwo) * (real)0.5;
+			contact->penetration = penetration;
+
+			contact->body[0] = one->rigidBody;
+			contact->body[1] = two->rigidBody;
+
+			//Material dependent, for now just set to constants
+			contact->friction = globalFriction;
+			contact->restitution = globalRestitution;
+
+			count++;
+		}
+
+		return count;
+	}
+
+	static bool SphereRay(SphereCollider* sphere, const Ray& ray, RaycastHit& hit)
+	{
+		Vector3 relative = ray.origin - sphere->GetAxis(3);
+		real b = relative * ray.direction;
+		real c = relative * relative - sphere->radius * sphere->radius;
+
+		if (c <= 0)
+		{
+			hit.distance = 0;
+			hit.normal = ray.direction * -1;
+			return true;
+		}
+
+		real discriminant = b * b - c;
+		if (b > 0 || discriminant < 0) return false;
+
+		real t = -b - real_sqrt(discriminant);
+		if (t > ray.maxDistance) return false;
+
+		hit.distance = t;
+		hit.normal = (relative + ray.direction * t) * ((real)1 / sphere->radius);
+		return true;
+	}
+
+	// Slab test in the box's space, the last slab the ray enters gives the face it hits
+	static bool BoxRay(BoxCollider* box, const Ray& ray, RaycastHit& hit)
+	{
+		Vector3 origin = box->GetTransform().TransformInversePoint(ray.origin);
+		Vector3 direction = box->GetTransform().TransformInverseDirection(ray.direction);
+
+		real enter = 0, leave = ray.maxDistance;
+		int face = -1;
+		real side = 0;
+
+		for (unsigned k = 0; k < 3; k++)
+		{
+			real half = box->halfSize[k];
+
+			if (real_abs(direction[k]) < (real)1e-12)
+			{
+				if (real_abs(origin[k]) > half) return false;
+				continue;
+			}
+
+			real inverse = 1 / direction[k];
+			real first = (-half - origin[k]) * inverse;
+			real second = (half - origin[k]) * inverse;
+			real sign = -1;
+
+			if (first > second)
+			{
+				std::swap(first, second);
+				sign = 1;
+			}
+
+			if (first > enter)
+			{
+				enter = first;
+				face = (int)k;
+				side = sign;
+			}
+			if (second < leave) leave = second;
+			if (enter > leave) return false;
+		}
+
+		hit.distance = enter;
+		hit.normal = face < 0 ? ray.direction * -1 : box->GetAxis((unsigned)face) * side;
+		return true;
+	}
+
+	static bool ConvexRay(Collider* convex, const Ray& ray, RaycastHit& hit)
+	{
+		return GJK::Raycast(*convex, ray.origin, ray.direction, ray.maxDistance, hit.distance, hit.normal);
+	}
+
+	static bool HalfSpaceRay(HalfSpaceCollider* plane, const Ray& ray, RaycastHit& hit)
+	{
+		Vector3 normal = plane->GetWorldNormal();
+		real height = normal * ray.origin - plane->GetWorldDistance();
+
+		if (height <= 0)
+		{
+			hit.distance = 0;
+			hit.normal = ray.direction * -1;
+			return true;
+		}
+
+		real speed = normal * ray.direction;
+		if (speed >= 0 || -height / speed > ray.maxDistance) return false;
+
+		hit.distance = -height / speed;
+		hit.normal = normal;
+		return true;
+	}
+
+	// Shared by the mesh and the heightfield, which both cast the ray in their own space
+	template<class Triangles>
+	static bool TrianglesRay(Triangles* triangles, const Ray& ray, RaycastHit& hit)
+	{
+		const Matrix4& transform = triangles->GetTransform();
+		Vector3 origin = transform.TransformInversePoint(ray.origin);
+		Vector3 direction = transform.TransformInverseDirection(ray.direction);
+
+		unsigned index;
+		if (!triangles->Raycast(origin, direction, ray.maxDistance, hit.distance, index)) return false;
+
+		Vector3 a, b, c;
+		triangles->GetTriangle(index, a, b, c);
+
+		// Triangles are hit from either side, the normal faces the ray
+		Vector3 normal = (b - a) % (c - a);
+		if (normal * direction > 0) normal *= -1;
+		normal.Normalise();
+
+		hit.normal = transform.TransformDirection(normal);
+		return true;
+	}
+
+	// Keeps the closest hit among the children the compound's tree reports
+	class CompoundRayQuery
+	{
+		CompoundCollider* compound;
+		const Ray& ray;
+		RaycastHit& hit;
+
+	public:
+
+		bool found;
+
+		CompoundRayQuery(CompoundCollider* compound, const Ray& ray, RaycastHit& hit) : compound(compound), ray(ray), hit(hit), found(false)
+		{
+
+		}
+
+		real operator()(void* userData, real maxDistance)
+		{
+			Collider* child = compound->PlaceChild(static_cast<Collider*>(userData));
+
+			Ray clipped = ray;
+			clipped.maxDistance = maxDistance;
+
+			RaycastHit childHit;
+			if (!Raycast(child, clipped, childHit)) return maxDistance;
+
+			hit = childHit;
+			found = true;
+			return childHit.distance;
+		}
+	};
+
+	static bool CompoundRay(CompoundCollider* compound, const Ray& ray, RaycastHit& hit)
+	{
+		Ray local = ray;
+		local.origin = compound->GetTransform().TransformInversePoint(ray.origin);
+		local.direction = compound->GetTransform().TransformInverseDirection(ray.direction);
+
+		CompoundRayQuery callback(compound, ray, hit);
+		compound->QueryRay(local, callback);
+
+		return callback.found;
+	}
+
+	static bool SphereAndSphereCast(SphereCollider* shape, const Vector3& direction, real maxDistance, SphereCollider* target, RaycastHit& hit)
+	{
+		Vector3 relative = shape->GetAxis(3) - target->GetAxis(3);
+		real radius = shape->radius + target->radius;
+
+		real b = relative * direction;
+		real c = relative * relative - radius * radius;
+
+		if (c <= 0)
+		{
+			hit.distance = 0;
+			hit.normal = direction * -1;
+			hit.point = shape->GetAxis(3);
+			return true;
+		}
+
+		real discriminant = b * b - c;
+		if (b > 0 || discriminant < 0) return false;
+
+		real t = -b - real_sqrt(discriminant);
+		if (t > maxDistance) return false;
+
+		hit.distance = t;
+		hit.normal = (relative + direction * t) * ((real)1 / radius);
+		hit.point = target->GetAxis(3) + hit.normal * target->radius;
+		return true;
+	}
+
+	static bool ConvexCast(Collider* shape, const Vector3& direction, real maxDistance, Collider* target, RaycastHit& hit)
+	{
+		return GJK::Cast(*target, *shape, direction, maxDistance, hit.distance, hit.normal, hit.point);
+	}
+
+	// The shape's lowest point along the plane's normal is the first to reach the plane
+	static bool ConvexAndHalfSpaceCast(Collider* shape, const Vector3& direction, real maxDistance, HalfSpaceCollider* plane, RaycastHit& hit)
+	{
+		Vector3 normal = plane->GetWorldNormal();
+		Vector3 lowest = shape->GetSupport(normal * -1) - normal * shape->GetMargin();
+		real height = normal * lowest - plane->GetWorldDistance();
+
+		if (height <= 0)
+		{
+			hit.distance = 0;
+			hit.normal = direction * -1;
+			hit.point = lowest;
+			return true;
+		}
+
+		real speed = normal * direction;
+		if (speed >= 0 || -height / speed > maxDistance) return false;
+
+		hit.distance = -height / speed;
+		hit.normal = normal;
+		hit.point = lowest + direction * hit.distance;
+		return true;
+	}
+
+	// Support mapping of one triangle given in world space, a three point hull that lives on the stack
+	class TriangleSupport : public Collider
+	{
+	public:
+
+		Vector3 vertices[3];
+
+		TriangleSupport()
+		{
+			Collider::colliderType = ColliderType::ConvexHull;
+		}
+
+		Vector3 GetSupport(const Vector3& direction) const
+		{
+			real first = vertices[0] * direction, second = vertices[1] * direction, third = vertices[2] * direction;
+
+			if (first >= second && first >= third) return vertices[0];
+			return second >= third ? vertices[1] : vertices[2];
+		}
+
+	protected:
+
+		AABB CalculateBoundingBox(const Matrix4&) const
+		{
+			AABB box(vertices[0], vertices[0]);
+			return box.Merge(AABB(vertices[1], vertices[1])).Merge(AABB(vertices[2], vertices[2]));
+		}
+	};
+
+	// Casts against every triangle under the swept bounds, each one as a three point hull
+	template<class Triangles>
+	static bool ConvexAndTrianglesCast(Collider* shape, const Vector3& direction, real maxDistance, Triangles* triangles, RaycastHit& hit)
+	{
+		const AABB& box = shape->GetBoundingBox();
+		const AABB& bounds = triangles->GetBoundingBox();
+
+		// Past this distance the shape has left the triangles' bounds, so an unlimited cast still sweeps a finite box
+		real reach = std::min(maxDistance,
+			(bounds.GetCenter() - box.GetCenter()).Magnitude() + bounds.GetHalfSize().Magnitude() + box.GetHalfSize().Magnitude());
+		AABB swept = box.Merge(AABB(box.min + direction * reach, box.max + direction * reach));
+
+		triangles->hits.clear();
+		triangles->Query(triangles->ToLocalSpace(swept), triangles->hits);
+
+		TriangleSupport triangle;
+
+		const Matrix4& transform = triangles->GetTransform();
+		bool found = false;
+
+		for (unsigned h = 0; h < triangles->hits.size(); h++)
+		{
+			Vector3 a, b, c;
+			triangles->GetTriangle(triangles->hits[h], a, b, c);
+
+			triangle.vertices[0] = transform.TransformPoint(a);
+			triangle.vertices[1] = transform.TransformPoint(b);
+			triangle.vertices[2] = transform.TransformPoint(c);
+			triangle.SetTransform(Matrix4());
+
+			RaycastHit candidate;
+			if (GJK::Cast(triangle, *shape, direction, maxDistance, candidate.distance, candidate.normal, candidate.point))
+			{
+				hit = candidate;
+				maxDistance = candidate.distance;
+				found = true;
+			}
+		}
+
+		return found;
+	}
+
+	// Keeps the closest hit among the children whose bounds the swept shape enters
+	class CompoundShapeCast
+	{
+		CompoundCollider* compound;
+		Collider* shape;
+		const Vector3& direction;
+		RaycastHit& hit;
+
+	public:
+
+		bool found;
+
+		CompoundShapeCast(CompoundCollider* compound, Collider* shape, const Vector3& direction, RaycastHit& hit)
+			: compound(compound), shape(shape), direction(direction), hit(hit), found(false)
+		{
+
+		}
+
+		real operator()(void* userData, real maxDistance)
+		{
+			Collider* child = compound->PlaceChild(static_cast<Collider*>(userData));
+
+			RaycastHit childHit;
+			if (!ShapeCast(shape, direction, maxDistance, child, childHit)) return maxDistance;
+
+			hit = childHit;
+			found = true;
+			return childHit.distance;
+		}
+	};
+
+	static bool ConvexAndCompoundCast(Collider* shape, const Vector3& direction, real maxDistance, CompoundCollider* compound, RaycastHit& hit)
+	{
+		AABB box = compound->ToLocalSpace(shape->GetBoundingBox());
+
+		Ray local(box.GetCenter(), compound->GetTransform().TransformInverseDirection(direction), maxDistance);
+		local.extent = box.GetHalfSize();
+
+		CompoundShapeCast callback(compound, shape, direction, hit);
+		compound->QueryRay(local, callback);
+
+		return callback.found;
+	}
+};
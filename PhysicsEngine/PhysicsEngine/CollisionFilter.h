@@ -0,0 +1,59 @@
+#pragma once
+#include "Colliders.h"
+
+#define maxCollisionLayers 32
+
+
+// Decides which collider pairs the broadphase reports. A pair is reported when each collider's
+// group is in the other's mask and the layer matrix allows their two layers to meet.
+class CollisionFilter
+{
+	// Bit b of layerMasks[a] is set when layer a collides with layer b
+	unsigned layerMasks[maxCollisionLayers];
+
+public:
+
+	CollisionFilter()
+	{
+		for (unsigned i = 0; i < maxCollisionLayers; i++) layerMasks[i] = 0xffffffff;
+	}
+
+	// Layers outside the matrix are ignored
+	void SetLayerCollision(unsigned layerA, unsigned layerB, bool collide)
+	{
+		assert(layerA < maxCollisionLayers && layerB < maxCollisionLayers);
+		if (layerA >= maxCollisionLayers || layerB >= maxCollisionLayers) return;
+
+		if (collide)
+		{
+			layerMasks[layerA] |= 1u << layerB;
+			layerMasks[layerB] |= 1u << layerA;
+		}
+		else
+		{
+			layerMasks[layerA] &= ~(1u << layerB);
+			layerMasks[layerB] &= ~(1u << layerA);
+		}
+	}
+
+	// A layer outside the matrix meets nothing
+	bool CanLayersCollide(unsigned layerA, unsigned layerB) const
+	{
+		assert(layerA < maxCollisionLayers && layerB < maxCollisionLayers);
+		if (layerA >= maxCollisionLayers || layerB >= maxCollisionLayers) return false;
+
+		return (layerMasks[layerA] >> layerB) & 1u;
+	}
+
+	bool ShouldCollide(const Collider* one, const Collider* two) const
+	{
+		if (!(one->collisionGroup & two->collisionMask) || !(two->collisionGroup & one->collisionMask))
+			return false;
+
+		// A collider with a layer outside the matrix meets nothing
+		if (one->collisionLayer >= maxCollisionLayers || two->collisionLayer >= maxCollisionLayers)
+			return false;
+
+		return CanLayersCollide(one->collisionLayer, two->collisionLayer);
+	}
+};
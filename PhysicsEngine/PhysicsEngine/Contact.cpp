@@ -1,5 +1,6 @@
 #include "Contact.h"
 #include <assert.h>
+#include <algorithm>
 
 void Contact::CalculateInternals(real duration)
 {
@@ -7,6 +8,7 @@ void Contact::CalculateInternals(real duration)
 	{
 		body[0] = body[1];
 		body[1] = NULL;
+		contactNormal *= -1;
 	}
 
 	assert(body[0]);
@@ -339,4 +341,68 @@ void Contact::ResolveCollision(real duration)
 	CalculateInternals(duration);
 	ApplyPositionChange(rb1, rb2, penetration);
 	ApplyVelocityChange(rb1, rb2);
-}
\ No newline at end of file
+}
+
+void Contact::UpdatePenetration(const Contact& resolved, Vector3 linearChange[2], Vector3 angularChange[2])
+{
+	for (unsigned b = 0; b < 2; b++) if (body[b])
+	{
+		for (unsigned d = 0; d < 2; d++)
+		{
+			if (body[b] != resolved.body[d]) continue;
+
+			Vector3 deltaPosition = linearChange[d] + angularChange[d] % (contactPoint - body[b]->GetPosition());
+			penetration += (deltaPosition * contactNormal) * (b ? 1 : -1);
+		}
+	}
+}
+
+void Contact::ResolveContacts(Contact* contacts, unsigned count, real duration)
+{
+	for (unsigned i = 0; i < count; i++)
+	{
+		unsigned deepest = i;
+		for (unsigned j = i + 1; j < count; j++)
+		{
+			if (contacts[j].penetration > contacts[deepest].penetration) deepest = j;
+		}
+		std::swap(contacts[i], contacts[deepest]);
+
+		Contact& contact = contacts[i];
+		contact.CalculateInternals(duration);
+
+		if (contact.penetration <= 0) continue;
+
+		Vector3 linearChange[2], angularChange[2];
+		contact.ApplyPositionChange(linearChange, angularChange, contact.penetration);
+
+		for (unsigned j = i + 1; j < count; j++)
+		{
+			contacts[j].UpdatePenetration(contact, linearChange, angularChange);
+		}
+	}
+
+	// Each impulse changes the velocity at the other contacts, so keep resolving whichever contact
+	// is closing fastest until none is left closing
+	for (unsigned iteration = 0; iteration < count * 4; iteration++)
+	{
+		unsigned fastest = count;
+		real maxDelta = 0;
+
+		for (unsigned i = 0; i < count; i++)
+		{
+			contacts[i].CalculateInternals(duration);
+
+			if (contacts[i].desiredDeltaVelocity > maxDelta)
+			{
+				maxDelta = contacts[i].desiredDeltaVelocity;
+				fastest = i;
+			}
+		}
+
+		if (fastest == count) break;
+
+		Vector3 velocityChange[2], rotationChange[2];
+		contacts[fastest].ApplyVelocityChange(velocityChange, rotationChange);
+	}
+}
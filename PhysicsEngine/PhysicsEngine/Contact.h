@@ -33,8 +33,55 @@ private:
 	Vector3 CalculateFrictionlessImpulse(Matrix3 *inverseInertiaTensor);
 	Vector3 CalculateFrictionImpulse(Matrix3 *inverseInertiaTensor);
 
+	void UpdatePenetration(const Contact& resolved, Vector3 linearChange[2], Vector3 angularChange[2]);
+
 public:
 
 	void ResolveCollision(real duration);
+
+	// Resolves the contacts of one manifold deepest first. Every resolution corrects the penetration
+	// of the remaining contacts, and contacts that are already separating get no impulse.
+	static void ResolveContacts(Contact* contacts, unsigned count, real duration);
 };
 
+
+// Contacts of one step, stored contiguously and reused from step to step. Storage only grows
+// when a step produces more contacts than any step before, so a settled world allocates nothing.
+class ContactBuffer
+{
+	std::vector<Contact> contacts;
+	unsigned count;
+
+public:
+
+	ContactBuffer(unsigned capacity = 256) : contacts(capacity), count(0)
+	{
+
+	}
+
+	void Reset()
+	{
+		count = 0;
+	}
+
+	// The returned contact is only valid until the next allocation, fill it in before asking for another
+	Contact* Allocate()
+	{
+		if (count == contacts.size())
+		{
+			contacts.resize(contacts.empty() ? 16 : contacts.size() * 2);
+		}
+
+		return &contacts[count++];
+	}
+
+	unsigned Size() const
+	{
+		return count;
+	}
+
+	Contact& operator[](unsigned index)
+	{
+		return contacts[index];
+	}
+};
@@ -0,0 +1,115 @@
+#pragma once
+#include "SensorScene.h"
+#include <thread>
+#include <functional>
+#include <math.h>
+
+
+// Lidar or depth camera with a regular grid of beams. Beam (column, row) points at an azimuth and an
+// elevation spread evenly over the fields of view, in the sensor's space the grid is centred on +z
+// with y up and azimuth growing towards +x. A field of view of 2 pi gives a spinning lidar.
+// Neighbouring beams of a row are traced together as one packet.
+class DepthSensor
+{
+	unsigned columns;
+	unsigned rows;
+
+	// Beam directions in the sensor's space, row after row
+	std::vector<Vector3> beams;
+
+	void ScanRows(const SensorScene& scene, const Matrix4& pose, float* ranges, unsigned begin, unsigned end) const
+	{
+		Vector3 origin = pose.GetAxisVector(3);
+		RayPacket packet;
+
+		for (unsigned row = begin; row < end; row++)
+		{
+			const Vector3* beam = &beams[row * columns];
+			float* range = ranges + row * columns;
+
+			for (unsigned column = 0; column < columns; column += rayPacketSize)
+			{
+				// A short last packet repeats its last beam in the unused lanes
+				unsigned count = std::min((unsigned)rayPacketSize, columns - column);
+				for (unsigned lane = 0; lane < rayPacketSize; lane++)
+				{
+					unsigned index = column + std::min(lane, count - 1);
+					packet.Set(lane, origin, pose.TransformDirection(beam[index]), maxRange);
+				}
+
+				unsigned hits = scene.Trace(packet);
+
+				for (unsigned lane = 0; lane < count; lane++)
+				{
+					range[column + lane] = (hits >> lane) & 1 ? (float)packet.distance[lane] : 0.0f;
+				}
+			}
+		}
+	}
+
+public:
+
+	real maxRange;
+
+	DepthSensor(unsigned columns, unsigned rows, real horizontalFieldOfView, real verticalFieldOfView, real maxRange)
+		: columns(columns), rows(rows), maxRange(maxRange)
+	{
+		beams.resize((size_t)columns * rows);
+
+		for (unsigned row = 0; row < rows; row++)
+		{
+			real elevation = verticalFieldOfView * ((row + (real)0.5) / rows - (real)0.5);
+
+			for (unsigned column = 0; column < columns; column++)
+			{
+				real azimuth = horizontalFieldOfView * ((column + (real)0.5) / columns - (real)0.5);
+
+				beams[row * columns + column] = Vector3(
+					cos(elevation) * sin(azimuth),
+					sin(elevation),
+					cos(elevation) * cos(azimuth));
+			}
+		}
+	}
+
+	unsigned GetColumns() const
+	{
+		return columns;
+	}
+
+	unsigned GetRows() const
+	{
+		return rows;
+	}
+
+	// Direction of a beam in the sensor's space
+	const Vector3& GetBeam(unsigned column, unsigned row) const
+	{
+		return beams[row * columns + column];
+	}
+
+	// Traces every beam from the sensor placed at pose and writes the range image into ranges, which
+	// must hold columns * rows values, row after row. Beams that hit nothing within maxRange read 0.
+	// The rows are split evenly across threadCount threads, the calling thread takes the first share.
+	void Scan(const SensorScene& scene, const Matrix4& pose, float* ranges, unsigned threadCount = 1) const
+	{
+		if (rows == 0 || columns == 0) return;
+
+		if (threadCount < 1) threadCount = 1;
+		if (threadCount > rows) threadCount = rows;
+
+		std::vector<std::thread> threads;
+		for (unsigned t = 1; t < threadCount; t++)
+		{
+			threads.push_back(std::thread(&DepthSensor::ScanRows, this,
+				std::cref(scene), std::cref(pose), ranges, rows * t / threadCount, rows * (t + 1) / threadCount));
+		}
+
+		ScanRows(scene, pose, ranges, 0, rows / threadCount);
+
+		for (unsigned t = 0; t < threads.size(); t++)
+		{
+			threads[t].join();
+		}
+	}
+};
@@ -0,0 +1,565 @@
+#pragma once
+#include "Ray.h"
+#include "Overlap.h"
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+
+// Incrementally updated bounding volume hierarchy. Leaves store a fat box that is larger than
+// the bounds given by the user, so small movements do not change the tree. Inner nodes are kept
+// height balanced by rotations, so queries stay logarithmic.
+class DynamicAABBTree
+{
+public:
+
+	static const int nullNode = -1;
+
+	class Node
+	{
+	public:
+
+		AABB box;
+		void* userData;
+
+		// Parent while the node is in the tree, next free node while it is in the free list
+		int parent;
+		int child1;
+		int child2;
+
+		// Leaves have height 0, free nodes -1
+		int height;
+
+		bool IsLeaf() const
+		{
+			return child1 == nullNode;
+		}
+	};
+
+private:
+
+	std::vector<Node> nodes;
+	int root;
+	int freeList;
+	real margin;
+
+	std::vector<int> stack;
+	std::vector<std::pair<int, int>> pairStack;
+
+	int AllocateNode()
+	{
+		int index;
+		if (freeList == nullNode)
+		{
+			index = (int)nodes.size();
+			nodes.push_back(Node());
+		}
+		else
+		{
+			index = freeList;
+			freeList = nodes[index].parent;
+		}
+
+		Node& node = nodes[index];
+		node.userData = NULL;
+		node.parent = nullNode;
+		node.child1 = nullNode;
+		node.child2 = nullNode;
+		node.height = 0;
+
+		return index;
+	}
+
+	void FreeNode(int index)
+	{
+		nodes[index].parent = freeList;
+		nodes[index].height = -1;
+		freeList = index;
+	}
+
+	void InsertLeaf(int leaf)
+	{
+		if (root == nullNode)
+		{
+			root = leaf;
+			nodes[root].parent = nullNode;
+			return;
+		}
+
+		// Descend towards the sibling with the cheapest surface area increase
+		AABB leafBox = nodes[leaf].box;
+		int index = root;
+		while (!nodes[index].IsLeaf())
+		{
+			int child1 = nodes[index].child1;
+			int child2 = nodes[index].child2;
+
+			real area = nodes[index].box.SurfaceArea();
+			real combinedArea = nodes[index].box.Merge(leafBox).SurfaceArea();
+
+			real cost = 2 * combinedArea;
+			real inheritanceCost = 2 * (combinedArea - area);
+
+			real cost1 = leafBox.Merge(nodes[child1].box).SurfaceArea() + inheritanceCost;
+			if (!nodes[child1].IsLeaf()) cost1 -= nodes[child1].box.SurfaceArea();
+
+			real cost2 = leafBox.Merge(nodes[child2].box).SurfaceArea() + inheritanceCost;
+			if (!nodes[child2].IsLeaf()) cost2 -= nodes[child2].box.SurfaceArea();
+
+			if (cost < cost1 && cost < cost2) break;
+
+			index = cost1 < cost2 ? child1 : child2;
+		}
+
+		int sibling = index;
+		int oldParent = nodes[sibling].parent;
+		int newParent = AllocateNode();
+
+		nodes[newParent].parent = oldParent;
+		nodes[newParent].box = leafBox.Merge(nodes[sibling].box);
+		nodes[newParent].height = nodes[sibling].height + 1;
+		nodes[newParent].child1 = sibling;
+		nodes[newParent].child2 = leaf;
+		nodes[sibling].parent = newParent;
+		nodes[leaf].parent = newParent;
+
+		if (oldParent != nullNode)
+		{
+			if (nodes[oldParent].child1 == sibling) nodes[oldParent].child1 = newParent;
+			else nodes[oldParent].child2 = newParent;
+		}
+		else
+		{
+			root = newParent;
+		}
+
+		Refit(nodes[leaf].parent);
+	}
+
+	void RemoveLeaf(int leaf)
+	{
+		if (leaf == root)
+		{
+			root = nullNode;
+			return;
+		}
+
+		int parent = nodes[leaf].parent;
+		int grandParent = nodes[parent].parent;
+		int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+		if (grandParent != nullNode)
+		{
+			if (nodes[grandParent].child1 == parent) nodes[grandParent].child1 = sibling;
+			else nodes[grandParent].child2 = sibling;
+
+			nodes[sibling].parent = grandParent;
+			FreeNode(parent);
+
+			Refit(grandParent);
+		}
+		else
+		{
+			root = sibling;
+			nodes[sibling].parent = nullNode;
+			FreeNode(parent);
+		}
+	}
+
+	// Walks up to the root rebalancing and recomputing heights and boxes
+	void Refit(int index)
+	{
+		while (index != nullNode)
+		{
+			index = Balance(index);
+
+			int child1 = nodes[index].child1;
+			int child2 = nodes[index].child2;
+
+			nodes[index].height = 1 + std::max(nodes[child1].height, nodes[child2].height);
+			nodes[index].box = nodes[child1].box.Merge(nodes[child2].box);
+
+			index = nodes[index].parent;
+		}
+	}
+
+	// Rotates the taller child of A up when the subtrees differ in height by more than one,
+	// returns the node that took A's place
+	int Balance(int iA)
+	{
+		Node& A = nodes[iA];
+		if (A.IsLeaf() || A.height < 2) return iA;
+
+		int iB = A.child1;
+		int iC = A.child2;
+		Node& B = nodes[iB];
+		Node& C = nodes[iC];
+
+		int balance = C.height - B.height;
+
+		if (balance > 1)
+		{
+			int iF = C.child1;
+			int iG = C.child2;
+			Node& F = nodes[iF];
+			Node& G = nodes[iG];
+
+			C.child1 = iA;
+			C.parent = A.parent;
+			A.parent = iC;
+
+			ReplaceChild(C.parent, iA, iC);
+
+			if (F.height > G.height)
+			{
+				C.child2 = iF;
+				A.child2 = iG;
+				G.parent = iA;
+				A.box = B.box.Merge(G.box);
+				C.box = A.box.Merge(F.box);
+				A.height = 1 + std::max(B.height, G.height);
+				C.height = 1 + std::max(A.height, F.height);
+			}
+			else
+			{
+				C.child2 = iG;
+				A.child2 = iF;
+				F.parent = iA;
+				A.box = B.box.Merge(F.box);
+				C.box = A.box.Merge(G.box);
+				A.height = 1 + std::max(B.height, F.height);
+				C.height = 1 + std::max(A.height, G.height);
+			}
+
+			return iC;
+		}
+
+		if (balance < -1)
+		{
+			int iD = B.child1;
+			int iE = B.child2;
+			Node& D = nodes[iD];
+			Node& E = nodes[iE];
+
+			B.child1 = iA;
+			B.parent = A.parent;
+			A.parent = iB;
+
+			ReplaceChild(B.parent, iA, iB);
+
+			if (D.height > E.height)
+			{
+				B.child2 = iD;
+				A.child1 = iE;
+				E.parent = iA;
+				A.box = C.box.Merge(E.box);
+				B.box = A.box.Merge(D.box);
+				A.height = 1 + std::max(C.height, E.height);
+				B.height = 1 + std::max(A.height, D.height);
+			}
+			else
+			{
+				B.child2 = iE;
+				A.child1 = iD;
+				D.parent = iA;
+				A.box = C.box.Merge(D.box);
+				B.box = A.box.Merge(E.box);
+				A.height = 1 + std::max(C.height, D.height);
+				B.height = 1 + std::max(A.height, E.height);
+			}
+
+			return iB;
+		}
+
+		return iA;
+	}
+
+	void ReplaceChild(int parent, int oldChild, int newChild)
+	{
+		if (parent == nullNode)
+		{
+			root = newChild;
+		}
+		else if (nodes[parent].child1 == oldChild)
+		{
+			nodes[parent].child1 = newChild;
+		}
+		else
+		{
+			nodes[parent].child2 = newChild;
+		}
+	}
+
+	AABB Fatten(const AABB& box, const Vector3& displacement) const
+	{
+		AABB fat = box;
+		fat.Enlarge(margin);
+
+		// Stretch the box along the predicted motion so fast bodies are not reinserted every step
+		if (displacement.x < 0) fat.min.x += displacement.x; else fat.max.x += displacement.x;
+		if (displacement.y < 0) fat.min.y += displacement.y; else fat.max.y += displacement.y;
+		if (displacement.z < 0) fat.min.z += displacement.z; else fat.max.z += displacement.z;
+
+		return fat;
+	}
+
+public:
+
+	DynamicAABBTree(real margin = (real)0.1) : root(nullNode), freeList(nullNode), margin(margin)
+	{
+
+	}
+
+	int CreateProxy(const AABB& box, void* userData)
+	{
+		int proxy = AllocateNode();
+
+		nodes[proxy].box = Fatten(box, Vector3());
+		nodes[proxy].userData = userData;
+
+		InsertLeaf(proxy);
+		return proxy;
+	}
+
+	void DestroyProxy(int proxy)
+	{
+		RemoveLeaf(proxy);
+		FreeNode(proxy);
+	}
+
+	// Returns true if the proxy had to be reinserted
+	bool MoveProxy(int proxy, const AABB& box, const Vector3& displacement = Vector3())
+	{
+		const AABB& fat = nodes[proxy].box;
+
+		if (fat.Contains(box))
+		{
+			// Keep the fat box unless it has grown far too large, e.g. after a fast body stopped
+			AABB huge = box;
+			huge.Enlarge(4 * margin);
+			if (huge.Contains(fat)) return false;
+		}
+
+		RemoveLeaf(proxy);
+		nodes[proxy].box = Fatten(box, displacement);
+		InsertLeaf(proxy);
+
+		return true;
+	}
+
+	const AABB& GetFatAABB(int proxy) const
+	{
+		return nodes[proxy].box;
+	}
+
+	void* GetUserData(int proxy) const
+	{
+		return nodes[proxy].userData;
+	}
+
+	int GetHeight() const
+	{
+		return root == nullNode ? 0 : nodes[root].height;
+	}
+
+	// Appends every leaf whose fat box overlaps the given box
+	void Query(const AABB& box, std::vector<int>& results)
+	{
+		if (root == nullNode) return;
+
+		stack.clear();
+		stack.push_back(root);
+
+		while (!stack.empty())
+		{
+			int index = stack.back();
+			stack.pop_back();
+
+			const Node& node = nodes[index];
+			if (!node.box.Overlaps(box)) continue;
+
+			if (node.IsLeaf())
+			{
+				results.push_back(index);
+			}
+			else
+			{
+				stack.push_back(node.child1);
+				stack.push_back(node.child2);
+			}
+		}
+	}
+
+	// Calls callback(userData, maxDistance) for every leaf whose fat box the ray, or the box it sweeps, enters within maxDistance
+	// and continues with the distance the callback returns. Nearer children are visited first so a
+	// shortened ray culls the rest of the tree early.
+	template<class Callback>
+	real QueryRay(const Ray& ray, Callback& callback)
+	{
+		real maxDistance = ray.maxDistance;
+		if (root == nullNode) return maxDistance;
+
+		Vector3 inverse = inverseDirection(ray.direction);
+
+		stack.clear();
+		stack.push_back(root);
+
+		while (!stack.empty())
+		{
+			int index = stack.back();
+			stack.pop_back();
+
+			real entry;
+			const Node& node = nodes[index];
+			if (!rayIntersectsBox(ray.origin, inverse, maxDistance, node.box, ray.extent, entry)) continue;
+
+			if (node.IsLeaf())
+			{
+				maxDistance = callback(node.userData, maxDistance);
+				continue;
+			}
+
+			real entry1, entry2;
+			bool hit1 = rayIntersectsBox(ray.origin, inverse, maxDistance, nodes[node.child1].box, ray.extent, entry1);
+			bool hit2 = rayIntersectsBox(ray.origin, inverse, maxDistance, nodes[node.child2].box, ray.extent, entry2);
+
+			if (hit1 && hit2)
+			{
+				int first = entry1 <= entry2 ? node.child1 : node.child2;
+				int second = entry1 <= entry2 ? node.child2 : node.child1;
+				stack.push_back(second);
+				stack.push_back(first);
+			}
+			else if (hit1)
+			{
+				stack.push_back(node.child1);
+			}
+			else if (hit2)
+			{
+				stack.push_back(node.child2);
+			}
+		}
+
+		return maxDistance;
+	}
+
+	// Calls callback(userData) for every leaf whose fat box overlaps the box, until it returns false.
+	// Returns false when the callback ended the query.
+	template<class Callback>
+	bool Query(const AABB& box, Callback& callback)
+	{
+		if (root == nullNode) return true;
+
+		stack.clear();
+		stack.push_back(root);
+
+		while (!stack.empty())
+		{
+			int index = stack.back();
+			stack.pop_back();
+
+			const Node& node = nodes[index];
+			if (!node.box.Overlaps(box)) continue;
+
+			if (node.IsLeaf())
+			{
+				if (!callback(node.userData)) return false;
+			}
+			else
+			{
+				stack.push_back(node.child1);
+				stack.push_back(node.child2);
+			}
+		}
+
+		return true;
+	}
+
+	// Calls callback(userData, maxDistance) for every leaf whose fat box is within maxDistance of the
+	// point and continues with the distance the callback returns. Nearer children are visited first.
+	template<class Callback>
+	real QueryNearest(const Vector3& point, real maxDistance, Callback& callback)
+	{
+		if (root == nullNode) return maxDistance;
+
+		stack.clear();
+		stack.push_back(root);
+
+		while (!stack.empty())
+		{
+			int index = stack.back();
+			stack.pop_back();
+
+			const Node& node = nodes[index];
+			if (distanceToBox(point, node.box) > maxDistance) continue;
+
+			if (node.IsLeaf())
+			{
+				maxDistance = callback(node.userData, maxDistance);
+				continue;
+			}
+
+			real distance1 = distanceToBox(point, nodes[node.child1].box);
+			real distance2 = distanceToBox(point, nodes[node.child2].box);
+
+			if (distance1 <= distance2)
+			{
+				stack.push_back(node.child2);
+				stack.push_back(node.child1);
+			}
+			else
+			{
+				stack.push_back(node.child1);
+				stack.push_back(node.child2);
+			}
+		}
+
+		return maxDistance;
+	}
+
+	// Appends every pair of leaves whose fat boxes overlap by descending the tree against itself
+	void QueryPairs(std::vector<std::pair<int, int>>& pairs)
+	{
+		if (root == nullNode) return;
+
+		pairStack.clear();
+		pairStack.push_back(std::make_pair(root, root));
+
+		while (!pairStack.empty())
+		{
+			int a = pairStack.back().first;
+			int b = pairStack.back().second;
+			pairStack.pop_back();
+
+			const Node& nodeA = nodes[a];
+			const Node& nodeB = nodes[b];
+
+			if (a == b)
+			{
+				if (nodeA.IsLeaf()) continue;
+
+				pairStack.push_back(std::make_pair(nodeA.child1, nodeA.child1));
+				pairStack.push_back(std::make_pair(nodeA.child2, nodeA.child2));
+				pairStack.push_back(std::make_pair(nodeA.child1, nodeA.child2));
+				continue;
+			}
+
+			if (!nodeA.box.Overlaps(nodeB.box)) continue;
+
+			if (nodeA.IsLeaf() && nodeB.IsLeaf())
+			{
+				pairs.push_back(std::make_pair(a, b));
+			}
+			else if (nodeB.IsLeaf() || (!nodeA.IsLeaf() && nodeA.height >= nodeB.height))
+			{
+				pairStack.push_back(std::make_pair(nodeA.child1, b));
+				pairStack.push_back(std::make_pair(nodeA.child2, b));
+			}
+			else
+			{
+				pairStack.push_back(std::make_pair(a, nodeB.child1));
+				pairStack.push_back(std::make_pair(a, nodeB.child2));
+			}
+		}
+	}
+};
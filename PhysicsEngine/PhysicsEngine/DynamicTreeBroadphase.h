@@ -0,0 +1,86 @@
+#pragma once
+#include "Broadphase.h"
+#include "DynamicAABBTree.h"
+
+
+// Keeps every collider in a dynamic AABB tree. Colliders only touch the tree when they leave their
+// fat box, which suits scenes where most of the geometry is large and still.
+class DynamicTreeBroadphase : public Broadphase
+{
+	DynamicAABBTree tree;
+
+	std::vector<Collider*> colliders;
+	std::vector<std::pair<int, int>> treePairs;
+
+public:
+
+	DynamicTreeBroadphase(real margin = (real)0.1) : tree(margin)
+	{
+
+	}
+
+	void Add(Collider* collider)
+	{
+		collider->broadphaseProxy = tree.CreateProxy(collider->GetBoundingBox(), collider);
+		colliders.push_back(collider);
+	}
+
+	void Remove(Collider* collider)
+	{
+		std::vector<Collider*>::iterator it = std::find(colliders.begin(), colliders.end(), collider);
+		if (it == colliders.end()) return;
+
+		tree.DestroyProxy(collider->broadphaseProxy);
+		collider->broadphaseProxy = -1;
+		colliders.erase(it);
+	}
+
+	void Update()
+	{
+		for (unsigned i = 0; i < colliders.size(); i++)
+		{
+			tree.MoveProxy(colliders[i]->broadphaseProxy, colliders[i]->GetBoundingBox());
+		}
+	}
+
+	void FindPairs(std::vector<ColliderPair>& pairs)
+	{
+		treePairs.clear();
+		tree.QueryPairs(treePairs);
+
+		for (unsigned i = 0; i < treePairs.size(); i++)
+		{
+			Collider* one = static_cast<Collider*>(tree.GetUserData(treePairs[i].first));
+			Collider* two = static_cast<Collider*>(tree.GetUserData(treePairs[i].second));
+
+			// Fat boxes overlap, only report pairs whose tight boxes do as well
+			if (one->GetBoundingBox().Overlaps(two->GetBoundingBox()))
+			{
+				AddPair(pairs, one, two);
+			}
+		}
+	}
+
+	real QueryRay(const Ray& ray, RayQueryCallback& callback)
+	{
+		TreeRayQueryAdapter adapter(callback);
+		return tree.QueryRay(ray, adapter);
+	}
+
+	bool Query(const AABB& box, OverlapCallback& callback)
+	{
+		TreeOverlapAdapter adapter(callback);
+		return tree.Query(box, adapter);
+	}
+
+	real QueryNearest(const Vector3& point, real maxDistance, NearestCallback& callback)
+	{
+		TreeNearestAdapter adapter(callback);
+		return tree.QueryNearest(point, maxDistance, adapter);
+	}
+
+	DynamicAABBTree& GetTree()
+	{
+		return tree;
+	}
+};
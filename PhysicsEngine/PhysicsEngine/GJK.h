@@ -0,0 +1,633 @@
+#pragma once
+#include "Colliders.h"
+#include "NarrowphaseCache.h"
+#include <algorithm>
+
+
+#define gjkMaxIterations 64
+#define epaMaxIterations 64
+#define epaMaxPoints (epaMaxIterations + 4)
+#define epaMaxFaces (2 * epaMaxPoints)
+#define epaMaxEdges (3 * epaMaxFaces)
+
+// A vertex of the Minkowski difference one - two of the colliders' cores, with the support
+// points it came from and the direction that produced it
+class SupportPoint
+{
+public:
+
+	Vector3 point;
+	Vector3 onOne;
+	Vector3 onTwo;
+	Vector3 direction;
+
+	SupportPoint() {}
+
+	SupportPoint(const Collider& one, const Collider& two, const Vector3& direction) : direction(direction)
+	{
+		onOne = one.GetSupport(direction);
+		onTwo = two.GetSupport(direction * -1);
+		point = onOne - onTwo;
+	}
+};
+
+class Simplex
+{
+public:
+
+	SupportPoint points[4];
+
+	// Barycentric weights of the point of the simplex closest to the origin
+	real weights[4];
+
+	unsigned size = 0;
+
+	// Ignores points that are already in the simplex, they add no dimension
+	bool Add(const SupportPoint& support)
+	{
+		for (unsigned i = 0; i < size; i++)
+		{
+			if ((points[i].point - support.point).SquareMagnitude() < (real)1e-18) return false;
+		}
+
+		weights[size] = 0;
+		points[size++] = support;
+		return true;
+	}
+};
+
+
+// Result of a query between the cores of two convex colliders. The normal points from one
+// towards two, the points are on the cores and distance is negative when the cores overlap.
+class GJKResult
+{
+public:
+
+	Vector3 normal;
+	Vector3 pointOnOne;
+	Vector3 pointOnTwo;
+	real distance;
+};
+
+
+// Gilbert-Johnson-Keerthi distance between the cores of two convex colliders,
+// warm started from the simplex the pair ended with on the previous step
+class GJK
+{
+	// Keeps the vertices of the simplex listed in keep, with their weights
+	static void Reduce(Simplex& simplex, unsigned count, const unsigned* keep, const real* weights)
+	{
+		SupportPoint points[4];
+		for (unsigned i = 0; i < count; i++) points[i] = simplex.points[keep[i]];
+
+		for (unsigned i = 0; i < count; i++)
+		{
+			simplex.points[i] = points[i];
+			simplex.weights[i] = weights[i];
+		}
+		simplex.size = count;
+	}
+
+	static Vector3 ClosestOnSegment(Simplex& simplex, unsigned a, unsigned b)
+	{
+		Vector3 A = simplex.points[a].point;
+		Vector3 ab = simplex.points[b].point - A;
+
+		real length = ab * ab;
+		real t = length > 0 ? (A * ab) * -1 / length : 0;
+
+		if (t <= 0)
+		{
+			unsigned keep[1] = { a };
+			real weights[1] = { 1 };
+			Reduce(simplex, 1, keep, weights);
+			return A;
+		}
+		if (t >= 1)
+		{
+			unsigned keep[1] = { b };
+			real weights[1] = { 1 };
+			Reduce(simplex, 1, keep, weights);
+			return simplex.points[0].point;
+		}
+
+		unsigned keep[2] = { a, b };
+		real weights[2] = { 1 - t, t };
+		Reduce(simplex, 2, keep, weights);
+		return A + ab * t;
+	}
+
+	// Voronoi region test of Ericson's Real-Time Collision Detection, 5.1.5, for the origin
+	static Vector3 ClosestOnTriangle(Simplex& simplex, unsigned a, unsigned b, unsigned c)
+	{
+		Vector3 A = simplex.points[a].point;
+		Vector3 B = simplex.points[b].point;
+		Vector3 C = simplex.points[c].point;
+
+		Vector3 ab = B - A;
+		Vector3 ac = C - A;
+
+		real d1 = (ab * A) * -1;
+		real d2 = (ac * A) * -1;
+		if (d1 <= 0 && d2 <= 0) return ClosestOnSegment(simplex, a, a);
+
+		real d3 = (ab * B) * -1;
+		real d4 = (ac * B) * -1;
+		if (d3 >= 0 && d4 <= d3) return ClosestOnSegment(simplex, b, b);
+
+		real vc = d1 * d4 - d3 * d2;
+		if (vc <= 0 && d1 >= 0 && d3 <= 0) return ClosestOnSegment(simplex, a, b);
+
+		real d5 = (ab * C) * -1;
+		real d6 = (ac * C) * -1;
+		if (d6 >= 0 && d5 <= d6) return ClosestOnSegment(simplex, c, c);
+
+		real vb = d5 * d2 - d1 * d6;
+		if (vb <= 0 && d2 >= 0 && d6 <= 0) return ClosestOnSegment(simplex, a, c);
+
+		real va = d3 * d6 - d5 * d4;
+		if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0) return ClosestOnSegment(simplex, b, c);
+
+		real denominator = va + vb + vc;
+
+		// Collinear points, the closest point is on one of the edges
+		if (denominator <= (real)1e-18)
+		{
+			Simplex edges[3] = { simplex, simplex, simplex };
+			Vector3 closest[3] = {
+				ClosestOnSegment(edges[0], a, b),
+				ClosestOnSegment(edges[1], a, c),
+				ClosestOnSegment(edges[2], b, c)
+			};
+
+			unsigned best = 0;
+			for (unsigned i = 1; i < 3; i++)
+			{
+				if (closest[i].SquareMagnitude() < closest[best].SquareMagnitude()) best = i;
+			}
+
+			simplex = edges[best];
+			return closest[best];
+		}
+
+		real v = vb / denominator;
+		real w = vc / denominator;
+
+		unsigned keep[3] = { a, b, c };
+		real weights[3] = { 1 - v - w, v, w };
+		Reduce(simplex, 3, keep, weights);
+		return A + ab * v + ac * w;
+	}
+
+	// True when the origin is on the other side of plane abc than d, or the tetrahedron is flat
+	static bool OriginOutside(const Vector3& a, const Vector3& b, const Vector3& c, const Vector3& d)
+	{
+		Vector3 normal = (b - a) % (c - a);
+
+		real signOrigin = (a * normal) * -1;
+		real signD = (d - a) * normal;
+
+		if (signD * signD < (real)1e-24) return true;
+		return signOrigin * signD < 0;
+	}
+
+	static Vector3 ClosestOnTetrahedron(Simplex& simplex, bool& inside)
+	{
+		static const unsigned faces[4][4] = { { 0, 1, 2, 3 }, { 0, 2, 3, 1 }, { 0, 3, 1, 2 }, { 1, 3, 2, 0 } };
+
+		inside = true;
+
+		Simplex best;
+		Vector3 bestPoint;
+		real bestDistance = REAL_MAX;
+
+		for (unsigned f = 0; f < 4; f++)
+		{
+			const unsigned* face = faces[f];
+
+			if (!OriginOutside(simplex.points[face[0]].point, simplex.points[face[1]].point,
+				simplex.points[face[2]].point, simplex.points[face[3]].point)) continue;
+
+			inside = false;
+
+			Simplex candidate = simplex;
+			Vector3 point = ClosestOnTriangle(candidate, face[0], face[1], face[2]);
+
+			real distance = point.SquareMagnitude();
+			if (distance < bestDistance)
+			{
+				bestDistance = distance;
+				bestPoint = point;
+				best = candidate;
+			}
+		}
+
+		if (inside) return Vector3();
+
+		simplex = best;
+		return bestPoint;
+	}
+
+	// Closest point of the simplex to the origin, the simplex is reduced to the vertices supporting it
+	static Vector3 Closest(Simplex& simplex, bool& inside)
+	{
+		inside = false;
+
+		switch (simplex.size)
+		{
+		case 1:
+			simplex.weights[0] = 1;
+			return simplex.points[0].point;
+		case 2:
+			return ClosestOnSegment(simplex, 0, 1);
+		case 3:
+			return ClosestOnTriangle(simplex, 0, 1, 2);
+		default:
+			return ClosestOnTetrahedron(simplex, inside);
+		}
+	}
+
+public:
+
+	// Returns true when the cores overlap, the simplex is then the last one, which EPA starts from.
+	// Otherwise result holds the distance between the cores, their closest points and the normal.
+	// The cache's simplex is used to warm start and is updated with the final simplex.
+	static bool Distance(const Collider& one, const Collider& two, Simplex& simplex, GJKResult& result, NarrowphaseCache& cache)
+	{
+		simplex.size = 0;
+
+		// Last step's vertices of the pair, the supports are looked up again along the same directions
+		for (unsigned i = 0; i < cache.gjkSize; i++)
+		{
+			simplex.Add(SupportPoint(one, two, cache.gjkDirections[i]));
+		}
+
+		if (simplex.size == 0)
+		{
+			Vector3 direction = one.GetAxis(3) - two.GetAxis(3);
+			if (direction.SquareMagnitude() < (real)1e-18) direction = Vector3(1, 0, 0);
+
+			simplex.Add(SupportPoint(one, two, direction));
+		}
+
+		bool overlap = false;
+		Vector3 closest;
+
+		for (unsigned iteration = 0; iteration < gjkMaxIterations; iteration++)
+		{
+			bool inside;
+			closest = Closest(simplex, inside);
+
+			real distance = closest.SquareMagnitude();
+			if (inside || distance < (real)1e-18)
+			{
+				overlap = true;
+				break;
+			}
+
+			SupportPoint support(one, two, closest * -1);
+
+			// No vertex gets closer to the origin than the current point, it is the closest one
+			if (distance - closest * support.point <= distance * (real)1e-10) break;
+			if (!simplex.Add(support)) break;
+		}
+
+		cache.gjkSize = simplex.size;
+		for (unsigned i = 0; i < simplex.size; i++)
+		{
+			cache.gjkDirections[i] = simplex.points[i].direction;
+		}
+
+		if (overlap) return true;
+
+		result.pointOnOne = Vector3();
+		result.pointOnTwo = Vector3();
+		for (unsigned i = 0; i < simplex.size; i++)
+		{
+			result.pointOnOne += simplex.points[i].onOne * simplex.weights[i];
+			result.pointOnTwo += simplex.points[i].onTwo * simplex.weights[i];
+		}
+
+		result.distance = closest.Magnitude();
+		result.normal = closest * ((real)-1 / result.distance);
+		return false;
+	}
+
+	// Conservative advancement of moving along direction until it touches target. Every step moves it by
+	// the distance between the two over the rate at which the direction closes it, so it never passes
+	// the surface. Colliders that already touch hit at distance 0 with the normal against direction.
+	// The normal points from target towards moving and point is on target. Moving is put back where it
+	// started when the cast ends.
+	static bool Cast(const Collider& target, Collider& moving, const Vector3& direction, real maxDistance, real& distance, Vector3& normal, Vector3& point)
+	{
+		Matrix4 start = moving.GetTransform();
+
+		// Shared by the steps, every query starts from the simplex of the last one
+		NarrowphaseCache cache;
+
+		real margin = target.GetMargin();
+		real margins = margin + moving.GetMargin();
+		real t = 0;
+		bool hit = false;
+
+		normal = direction * -1;
+		point = moving.GetAxis(3);
+
+		for (unsigned iteration = 0; iteration < gjkMaxIterations; iteration++)
+		{
+			Matrix4 transform = start;
+			transform.data[3] += direction.x * t;
+			transform.data[7] += direction.y * t;
+			transform.data[11] += direction.z * t;
+			moving.SetTransform(transform);
+
+			// The cores only overlap at the start or when the last step closed the gap up to rounding,
+			// the normal and point are then the last ones found
+			Simplex simplex;
+			GJKResult result;
+			if (Distance(target, moving, simplex, result, cache))
+			{
+				hit = true;
+				break;
+			}
+
+			real gap = result.distance - margins;
+			if (gap < 0 && t == 0)
+			{
+				hit = true;
+				break;
+			}
+
+			normal = result.normal;
+			point = result.pointOnOne + result.normal * margin;
+
+			if (gap <= (real)1e-6)
+			{
+				hit = true;
+				break;
+			}
+
+			real closing = -(result.normal * direction);
+			if (closing <= 0) break;
+
+			t += gap / closing;
+			if (t > maxDistance) break;
+		}
+
+		moving.SetTransform(start);
+
+		if (hit) distance = t;
+		return hit;
+	}
+
+	// A point cast against the collider, see Cast
+	static bool Raycast(const Collider& shape, const Vector3& origin, const Vector3& direction, real maxDistance, real& distance, Vector3& normal)
+	{
+		SphereCollider ray;
+		ray.radius = 0;
+
+		Matrix4 transform;
+		transform.data[3] = origin.x;
+		transform.data[7] = origin.y;
+		transform.data[11] = origin.z;
+		ray.SetTransform(transform);
+
+		Vector3 point;
+		return Cast(shape, ray, direction, maxDistance, distance, normal, point);
+	}
+};
+
+
+// Expanding polytope algorithm, finds the penetration of two overlapping cores starting from the
+// simplex GJK ended with
+class EPA
+{
+	class Face
+	{
+	public:
+
+		unsigned a, b, c;
+		Vector3 normal;
+		real distance;
+	};
+
+	class Polytope
+	{
+	public:
+
+		SupportPoint points[epaMaxPoints];
+		Face faces[epaMaxFaces];
+		unsigned edges[epaMaxEdges][2];
+
+		unsigned pointCount = 0;
+		unsigned faceCount = 0;
+
+		// Winding is fixed so the normal points away from the interior point
+		bool AddFace(unsigned a, unsigned b, unsigned c, const Vector3& interior)
+		{
+			if (faceCount == epaMaxFaces) return false;
+
+			Vector3 normal = (points[b].point - points[a].point) % (points[c].point - points[a].point);
+			real length = normal.Magnitude();
+			if (length < (real)1e-18) return false;
+
+			normal *= (real)1 / length;
+			if (normal * (interior - points[a].point) > 0)
+			{
+				std::swap(b, c);
+				normal *= -1;
+			}
+
+			Face& face = faces[faceCount++];
+			face.a = a;
+			face.b = b;
+			face.c = c;
+			face.normal = normal;
+			face.distance = normal * points[a].point;
+			return true;
+		}
+	};
+
+	// Grows a simplex that touches the origin into a tetrahedron, false when the cores are too flat
+	static bool Expand(const Collider& one, const Collider& two, Simplex& simplex)
+	{
+		static const Vector3 axes[6] = {
+			Vector3(1, 0, 0), Vector3(-1, 0, 0), Vector3(0, 1, 0),
+			Vector3(0, -1, 0), Vector3(0, 0, 1), Vector3(0, 0, -1)
+		};
+
+		for (unsigned i = 0; i < 6 && simplex.size == 1; i++)
+		{
+			simplex.Add(SupportPoint(one, two, axes[i]));
+		}
+
+		if (simplex.size == 2)
+		{
+			Vector3 line = simplex.points[1].point - simplex.points[0].point;
+
+			unsigned axis = 0;
+			if (real_abs(line.y) < real_abs(line[axis])) axis = 1;
+			if (real_abs(line.z) < real_abs(line[axis])) axis = 2;
+
+			Vector3 first = line % axes[2 * axis];
+			Vector3 second = line % first;
+			Vector3 directions[4] = { first, first * -1, second, second * -1 };
+
+			for (unsigned i = 0; i < 4 && simplex.size == 2; i++)
+			{
+				SupportPoint support(one, two, directions[i]);
+				if (((support.point - simplex.points[0].point) % line).SquareMagnitude() > (real)1e-18 * line.SquareMagnitude())
+				{
+					simplex.Add(support);
+				}
+			}
+		}
+
+		if (simplex.size == 3)
+		{
+			Vector3 normal = (simplex.points[1].point - simplex.points[0].point) % (simplex.points[2].point - simplex.points[0].point);
+			Vector3 directions[2] = { normal, normal * -1 };
+
+			for (unsigned i = 0; i < 2 && simplex.size == 3; i++)
+			{
+				SupportPoint support(one, two, directions[i]);
+				real height = (support.point - simplex.points[0].point) * normal;
+				if (height * height > (real)1e-18 * normal.SquareMagnitude())
+				{
+					simplex.Add(support);
+				}
+			}
+		}
+
+		return simplex.size == 4;
+	}
+
+	static void AddEdge(Polytope& polytope, unsigned& edgeCount, unsigned a, unsigned b)
+	{
+		// An edge shared with another removed face is not on the horizon
+		for (unsigned i = 0; i < edgeCount; i++)
+		{
+			if (polytope.edges[i][0] == b && polytope.edges[i][1] == a)
+			{
+				polytope.edges[i][0] = polytope.edges[edgeCount - 1][0];
+				polytope.edges[i][1] = polytope.edges[edgeCount - 1][1];
+				edgeCount--;
+				return;
+			}
+		}
+
+		if (edgeCount == epaMaxEdges) return;
+
+		polytope.edges[edgeCount][0] = a;
+		polytope.edges[edgeCount][1] = b;
+		edgeCount++;
+	}
+
+public:
+
+	// Fills result with the penetration of the cores as a negative distance. Returns false
+	// when no penetration could be found, e.g. for two flat cores.
+	static bool Penetration(const Collider& one, const Collider& two, Simplex& simplex, GJKResult& result)
+	{
+		if (simplex.size < 4 && !Expand(one, two, simplex)) return false;
+
+		Polytope polytope;
+
+		Vector3 interior;
+		for (unsigned i = 0; i < 4; i++)
+		{
+			polytope.points[i] = simplex.points[i];
+			interior += simplex.points[i].point * (real)0.25;
+		}
+		polytope.pointCount = 4;
+
+		if (!polytope.AddFace(0, 1, 2, interior) || !polytope.AddFace(0, 3, 1, interior) ||
+			!polytope.AddFace(0, 2, 3, interior) || !polytope.AddFace(1, 3, 2, interior)) return false;
+
+		unsigned closest = 0;
+
+		for (unsigned iteration = 0; iteration < epaMaxIterations; iteration++)
+		{
+			closest = 0;
+			for (unsigned i = 1; i < polytope.faceCount; i++)
+			{
+				if (polytope.faces[i].distance < polytope.faces[closest].distance) closest = i;
+			}
+
+			const Face& face = polytope.faces[closest];
+			SupportPoint support(one, two, face.normal);
+
+			// The polytope cannot grow past the closest face any more
+			if (support.point * face.normal - face.distance < (real)1e-6 * ((real)1 + face.distance)) break;
+			if (polytope.pointCount == epaMaxPoints) break;
+
+			unsigned index = polytope.pointCount++;
+			polytope.points[index] = support;
+
+			// Remove every face the new point sees, keeping the edges of the hole
+			unsigned edgeCount = 0;
+			unsigned kept = 0;
+			for (unsigned i = 0; i < polytope.faceCount; i++)
+			{
+				const Face& visible = polytope.faces[i];
+				if (visible.normal * (support.point - polytope.points[visible.a].point) > 0)
+				{
+					AddEdge(polytope, edgeCount, visible.a, visible.b);
+					AddEdge(polytope, edgeCount, visible.b, visible.c);
+					AddEdge(polytope, edgeCount, visible.c, visible.a);
+				}
+				else
+				{
+					polytope.faces[kept++] = visible;
+				}
+			}
+
+			if (kept == polytope.faceCount)
+			{
+				polytope.pointCount--;
+				break;
+			}
+			polytope.faceCount = kept;
+
+			for (unsigned i = 0; i < edgeCount; i++)
+			{
+				polytope.AddFace(polytope.edges[i][0], polytope.edges[i][1], index, interior);
+			}
+
+			if (polytope.faceCount == 0) return false;
+		}
+
+		closest = 0;
+		for (unsigned i = 1; i < polytope.faceCount; i++)
+		{
+			if (polytope.faces[i].distance < polytope.faces[closest].distance) closest = i;
+		}
+
+		const Face& face = polytope.faces[closest];
+		const SupportPoint& a = polytope.points[face.a];
+		const SupportPoint& b = polytope.points[face.b];
+		const SupportPoint& c = polytope.points[face.c];
+
+		// Barycentric coordinates of the origin projected on the face
+		Vector3 projected = face.normal * face.distance;
+		Vector3 ab = b.point - a.point, ac = c.point - a.point, ap = projected - a.point;
+
+		real d00 = ab * ab, d01 = ab * ac, d11 = ac * ac;
+		real d20 = ap * ab, d21 = ap * ac;
+		real denominator = d00 * d11 - d01 * d01;
+
+		real v = 0, w = 0;
+		if (denominator > (real)1e-18)
+		{
+			v = (d11 * d20 - d01 * d21) / denominator;
+			w = (d00 * d21 - d01 * d20) / denominator;
+		}
+		real u = 1 - v - w;
+
+		result.pointOnOne = a.onOne * u + b.onOne * v + c.onOne * w;
+		result.pointOnTwo = a.onTwo * u + b.onTwo * v + c.onTwo * w;
+		result.normal = face.normal;
+		result.distance = -face.distance;
+		return true;
+	}
+};
@@ -0,0 +1,50 @@
+#pragma once
+#include <stddef.h>
+
+
+// Read only view of a whole file mapped into memory. Pages are loaded by the OS when first touched,
+// so opening a large file costs no reading and no copying.
+class MappedFile
+{
+	const void* data;
+	size_t size;
+
+#if defined(_WIN32)
+	void* file;
+	void* mapping;
+#else
+	int file;
+#endif
+
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+public:
+
+	MappedFile();
+
+	// Returns false when the file cannot be opened or is empty
+	bool Open(const char* path);
+
+	void Close();
+
+	bool IsOpen() const
+	{
+		return data != NULL;
+	}
+
+	const void* GetData() const
+	{
+		return data;
+	}
+
+	size_t GetSize() const
+	{
+		return size;
+	}
+
+	~MappedFile()
+	{
+		Close();
+	}
+};
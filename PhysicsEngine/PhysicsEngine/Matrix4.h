@@ -28,6 +28,14 @@ public:
 		data[10] = c;
 	}
 
+	bool IsIdentity() const
+	{
+		return data[0] == 1 && data[5] == 1 && data[10] == 1 &&
+			data[1] == 0 && data[2] == 0 && data[3] == 0 &&
+			data[4] == 0 && data[6] == 0 && data[7] == 0 &&
+			data[8] == 0 && data[9] == 0 && data[11] == 0;
+	}
+
 	Matrix4 operator*(const Matrix4 &o) const
 	{
 		Matrix4 result;
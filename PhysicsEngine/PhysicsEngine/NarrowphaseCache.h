@@ -0,0 +1,40 @@
+#pragma once
+#include "Vector3.h"
+
+
+#define maxManifoldPoints 4
+
+// Contact point kept between steps, stored in the space of each collider
+class ManifoldPoint
+{
+public:
+
+	Vector3 localOne;
+	Vector3 localTwo;
+};
+
+
+// Narrowphase state of one collider pair, kept by the pair cache from step to step
+// so the collision routines can start from last step's result
+class NarrowphaseCache
+{
+public:
+
+	// Separating or smallest penetration axis of the last box-box test, 0xffffff when unknown
+	unsigned boxAxis;
+
+	// Directions that produced the vertices of the last GJK simplex, looking the supports up again
+	// along them rebuilds last step's simplex on the moved colliders
+	Vector3 gjkDirections[4];
+	unsigned gjkSize;
+
+	// Contact points of the last steps for the routines that find a single point per step,
+	// one extra slot is used while a new point is merged in
+	ManifoldPoint manifold[maxManifoldPoints + 1];
+	unsigned manifoldSize;
+
+	NarrowphaseCache() : boxAxis(0xffffff), gjkSize(0), manifoldSize(0)
+	{
+
+	}
+};
@@ -0,0 +1,88 @@
+#pragma once
+#include "AABB.h"
+
+class Collider;
+
+
+// Receives the colliders whose bounding boxes overlap a query box. Returning false ends the query,
+// e.g. once the caller's buffer is full.
+class OverlapCallback
+{
+public:
+
+	virtual bool ReportCollider(Collider* collider) = 0;
+
+	virtual ~OverlapCallback()
+	{
+
+	}
+};
+
+
+// Receives the colliders whose bounding boxes are within maxDistance of a query point. Returns the
+// distance the rest of the query is limited to, so that a k nearest query closes in as it fills up.
+class NearestCallback
+{
+public:
+
+	virtual real ReportCollider(Collider* collider, real maxDistance) = 0;
+
+	virtual ~NearestCallback()
+	{
+
+	}
+};
+
+
+// Hand the user data of a DynamicAABBTree holding colliders to the callbacks above
+class TreeOverlapAdapter
+{
+	OverlapCallback& callback;
+
+public:
+
+	TreeOverlapAdapter(OverlapCallback& callback) : callback(callback)
+	{
+
+	}
+
+	bool operator()(void* userData)
+	{
+		return callback.ReportCollider(static_cast<Collider*>(userData));
+	}
+};
+
+class TreeNearestAdapter
+{
+	NearestCallback& callback;
+
+public:
+
+	TreeNearestAdapter(NearestCallback& callback) : callback(callback)
+	{
+
+	}
+
+	real operator()(void* userData, real maxDistance)
+	{
+		return callback.ReportCollider(static_cast<Collider*>(userData), maxDistance);
+	}
+};
+
+
+// Distance from a point to the nearest point of a box, 0 inside it
+static inline real distanceToBox(const Vector3& point, const AABB& box)
+{
+	real square = 0;
+
+	for (unsigned k = 0; k < 3; k++)
+	{
+		real outside = 0;
+		if (point[k] < box.min[k]) outside = box.min[k] - point[k];
+		if (point[k] > box.max[k]) outside = point[k] - box.max[k];
+
+		square += outside * outside;
+	}
+
+	return real_sqrt(square);
+}
@@ -0,0 +1,161 @@
+#pragma once
+#include "Broadphase.h"
+#include "NarrowphaseCache.h"
+
+
+// A pair of colliders that has been overlapping since it was reported by the broadphase.
+// Whatever is stored here survives between steps until the pair stops overlapping.
+class OverlappingPair
+{
+public:
+
+	static const unsigned userDataSlots = 4;
+
+	Collider* one;
+	Collider* two;
+
+	// Deepest penetration of the last step, zero when the narrowphase found no contact
+	real penetration;
+
+	NarrowphaseCache narrowphase;
+
+	void* userData[userDataSlots];
+
+	OverlappingPair() : one(NULL), two(NULL), penetration(0)
+	{
+		for (unsigned i = 0; i < userDataSlots; i++) userData[i] = NULL;
+	}
+
+	OverlappingPair(const ColliderPair& pair) : OverlappingPair()
+	{
+		one = pair.one;
+		two = pair.two;
+	}
+};
+
+
+// Keeps the broadphase pairs across steps. Each update merges the new pairs with the cached ones,
+// so pairs that persist keep their data, and begin and end deltas are reported.
+class PairCache
+{
+	std::vector<OverlappingPair> pairs;
+	std::vector<OverlappingPair> scratch;
+
+	std::vector<ColliderPair> begun;
+	std::vector<OverlappingPair> ended;
+	std::vector<OverlappingPair> removed;
+
+	// Orders by the colliders' ids rather than their addresses, which change from run to run
+	static bool Less(const Collider* a, const Collider* b)
+	{
+		if (a->id != b->id) return a->id < b->id;
+		return a < b;
+	}
+
+	static bool Less(const Collider* oneA, const Collider* twoA, const Collider* oneB, const Collider* twoB)
+	{
+		if (oneA != oneB) return Less(oneA, oneB);
+		return Less(twoA, twoB);
+	}
+
+	static bool ComparePairs(const ColliderPair& a, const ColliderPair& b)
+	{
+		return Less(a.one, a.two, b.one, b.two);
+	}
+
+public:
+
+	// Sorts the given pairs and merges them into the cache
+	void Update(std::vector<ColliderPair>& found)
+	{
+		for (unsigned i = 0; i < found.size(); i++)
+		{
+			if (Less(found[i].two, found[i].one)) std::swap(found[i].one, found[i].two);
+		}
+
+		std::sort(found.begin(), found.end(), ComparePairs);
+
+		scratch.clear();
+		begun.clear();
+		ended.swap(removed);
+		removed.clear();
+
+		unsigned i = 0, j = 0;
+		while (i < pairs.size() || j < found.size())
+		{
+			if (j > 0 && j < found.size() && found[j].one == found[j - 1].one && found[j].two == found[j - 1].two)
+			{
+				j++;
+				continue;
+			}
+
+			if (j == found.size() || (i < pairs.size() && Less(pairs[i].one, pairs[i].two, found[j].one, found[j].two)))
+			{
+				ended.push_back(pairs[i++]);
+			}
+			else if (i == pairs.size() || Less(found[j].one, found[j].two, pairs[i].one, pairs[i].two))
+			{
+				scratch.push_back(OverlappingPair(found[j]));
+				begun.push_back(found[j++]);
+			}
+			else
+			{
+				scratch.push_back(pairs[i++]);
+				j++;
+			}
+		}
+
+		pairs.swap(scratch);
+	}
+
+	// Drops every pair of the collider, they are reported as ended by the next update
+	void Remove(Collider* collider)
+	{
+		unsigned kept = 0;
+		for (unsigned i = 0; i < pairs.size(); i++)
+		{
+			if (pairs[i].one == collider || pairs[i].two == collider)
+			{
+				removed.push_back(pairs[i]);
+			}
+			else
+			{
+				pairs[kept++] = pairs[i];
+			}
+		}
+		pairs.resize(kept);
+	}
+
+	OverlappingPair* Find(Collider* one, Collider* two)
+	{
+		if (Less(two, one)) std::swap(one, two);
+
+		unsigned low = 0, high = (unsigned)pairs.size();
+		while (low < high)
+		{
+			unsigned mid = (low + high) / 2;
+			if (Less(pairs[mid].one, pairs[mid].two, one, two)) low = mid + 1;
+			else high = mid;
+		}
+
+		if (low < pairs.size() && pairs[low].one == one && pairs[low].two == two) return &pairs[low];
+		return NULL;
+	}
+
+	std::vector<OverlappingPair>& GetPairs()
+	{
+		return pairs;
+	}
+
+	// Pairs that started overlapping in the last update
+	const std::vector<ColliderPair>& GetBegunPairs() const
+	{
+		return begun;
+	}
+
+	// Pairs that stopped overlapping in the last update, with the data they carried
+	const std::vector<OverlappingPair>& GetEndedPairs() const
+	{
+		return ended;
+	}
+};
@@ -0,0 +1,121 @@
+#pragma once
+#include "AABB.h"
+#include <algorithm>
+
+class Collider;
+
+
+// Half line from origin along direction, which must have unit length, up to maxDistance.
+// Colliders whose collision group shares no bit with mask are not hit.
+class Ray
+{
+public:
+
+	Vector3 origin;
+	Vector3 direction;
+	real maxDistance;
+	unsigned mask;
+
+	// Half size of a box swept along the ray instead of a point, for culling shape casts
+	Vector3 extent;
+
+	Ray() : maxDistance(REAL_MAX), mask(0xffffffff)
+	{
+
+	}
+
+	Ray(const Vector3& origin, const Vector3& direction, real maxDistance = REAL_MAX, unsigned mask = 0xffffffff)
+		: origin(origin), direction(direction), maxDistance(maxDistance), mask(mask)
+	{
+
+	}
+};
+
+
+// A ray starting inside a collider hits it at distance 0 with the normal against the ray
+class RaycastHit
+{
+public:
+
+	Collider* collider;
+	Vector3 point;
+	Vector3 normal;
+	real distance;
+
+	RaycastHit() : collider(NULL), distance(0)
+	{
+
+	}
+};
+
+
+// Receives the colliders whose bounds a ray enters. Returns the distance the rest of the query is
+// limited to, so that a closest hit query shortens the ray with every hit it finds.
+class RayQueryCallback
+{
+public:
+
+	virtual real ReportCollider(Collider* collider, real maxDistance) = 0;
+
+	virtual ~RayQueryCallback()
+	{
+
+	}
+};
+
+
+// Hands the user data of a DynamicAABBTree holding colliders to a RayQueryCallback
+class TreeRayQueryAdapter
+{
+	RayQueryCallback& callback;
+
+public:
+
+	TreeRayQueryAdapter(RayQueryCallback& callback) : callback(callback)
+	{
+
+	}
+
+	real operator()(void* userData, real maxDistance)
+	{
+		return callback.ReportCollider(static_cast<Collider*>(userData), maxDistance);
+	}
+};
+
+
+// Reciprocal of the direction for the slab tests, zero components get a huge finite value so that
+// a ray lying in a slab plane gives 0 instead of NaN
+static inline Vector3 inverseDirection(const Vector3& direction)
+{
+	return Vector3(
+		direction.x != 0 ? 1 / direction.x : REAL_MAX,
+		direction.y != 0 ? 1 / direction.y : REAL_MAX,
+		direction.z != 0 ? 1 / direction.z : REAL_MAX);
+}
+
+// Slab test, entry is the distance at which the ray enters the box, 0 when it starts inside
+static inline bool rayIntersectsBox(const Vector3& origin, const Vector3& inverse, real maxDistance, const AABB& box, real& entry)
+{
+	real enter = 0, leave = maxDistance;
+
+	for (unsigned k = 0; k < 3; k++)
+	{
+		real first = (box.min[k] - origin[k]) * inverse[k];
+		real second = (box.max[k] - origin[k]) * inverse[k];
+		if (first > second) std::swap(first, second);
+
+		if (first > enter) enter = first;
+		if (second < leave) leave = second;
+		if (enter > leave) return false;
+	}
+
+	entry = enter;
+	return true;
+}
+
+// Slab test of a box of the given half size swept along the ray, the same as the ray against the box
+// grown by that half size
+static inline bool rayIntersectsBox(const Vector3& origin, const Vector3& inverse, real maxDistance, const AABB& box, const Vector3& extent, real& entry)
+{
+	return rayIntersectsBox(origin, inverse, maxDistance, AABB(box.min - extent, box.max + extent), entry);
+}
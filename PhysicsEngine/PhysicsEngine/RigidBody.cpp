@@ -147,6 +147,16 @@ real RigidBody::GetAngularDamping() const
 	return angularDamping;
 }
 
+void RigidBody::SetContinuousCollision(const bool continuousCollision)
+{
+	this->continuousCollision = continuousCollision;
+}
+
+bool RigidBody::GetContinuousCollision() const
+{
+	return continuousCollision;
+}
+
 
 void RigidBody::SetPosition(const Vector3 &position)
 {
@@ -30,6 +30,8 @@ protected:
 	Vector3 forceAccum;
 	Vector3 torqueAccum;
 
+	bool continuousCollision = false;
+
 
 public:
 
@@ -47,6 +49,13 @@ public:
 	real GetLinearDamping() const;
 	real GetAngularDamping() const;
 
+	// Opt in to swept collision for small fast bodies that would otherwise pass through thin
+	// geometry in one step. The world only sweeps them on steps where they move farther than
+	// their own size. Sphere, box, capsule and convex hull colliders are swept, compounds through
+	// those children. Mesh and heightfield colliders of a flagged body are skipped.
+	void SetContinuousCollision(const bool continuousCollision);
+	bool GetContinuousCollision() const;
+
 	void SetPosition(const Vector3 &position);
 	void SetPosition(const real x,const real y,const real z);
 	void GetPosition(Vector3* position);
@@ -0,0 +1,472 @@
+#pragma once
+#include "World.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SENSOR_SCENE_AVX
+#endif
+
+
+// Rays traced together, one per lane of an AVX register of reals
+#define rayPacketSize 4
+
+#define sensorLeafSize 4
+#define sensorStackSize 64
+
+// Rays in structure of arrays form. Distance holds how far each ray may go and is lowered to the
+// distance of every hit found.
+class RayPacket
+{
+public:
+
+	alignas(32) real origin[3][rayPacketSize];
+	alignas(32) real direction[3][rayPacketSize];
+	alignas(32) real inverse[3][rayPacketSize];
+	alignas(32) real distance[rayPacketSize];
+
+	void Set(unsigned lane, const Vector3& rayOrigin, const Vector3& rayDirection, real maxDistance)
+	{
+		Vector3 rayInverse = inverseDirection(rayDirection);
+
+		for (unsigned k = 0; k < 3; k++)
+		{
+			origin[k][lane] = rayOrigin[k];
+			direction[k][lane] = rayDirection[k];
+			inverse[k][lane] = rayInverse[k];
+		}
+
+		distance[lane] = maxDistance;
+	}
+};
+
+
+// Boxes, spheres and half spaces of a world copied into a flat tree for tracing ray packets, e.g. for
+// simulated depth sensors. The copy is only read while tracing, so any number of threads may trace
+// against it at once. It does not follow the world, build it again after the world has stepped.
+// Surfaces are only seen from outside, a ray starting inside a shape passes through it.
+class SensorScene
+{
+	// Shapes are records of 16 reals: the 12 entries of the transform, the half size of a box or the
+	// radius of a sphere, and the kind. A sphere's centre is its translation.
+	static const unsigned boxShape = 0;
+	static const unsigned sphereShape = 1;
+
+	// Inner nodes are followed by their first child, leaves own shapes [first, first + count)
+	class Node
+	{
+	public:
+
+		AABB box;
+		unsigned secondChild;
+		unsigned axis;
+		unsigned first;
+		unsigned count;
+	};
+
+	std::vector<real> shapes;
+	std::vector<AABB> bounds;
+	std::vector<Node> nodes;
+
+	// Normal and distance of every half space
+	std::vector<real> planes;
+
+	// Used only while building
+	std::vector<unsigned> order;
+	std::vector<Vector3> centres;
+	std::vector<real> sortedShapes;
+
+	class CompareCentres
+	{
+		const std::vector<Vector3>& centres;
+		unsigned axis;
+
+	public:
+
+		CompareCentres(const std::vector<Vector3>& centres, unsigned axis) : centres(centres), axis(axis)
+		{
+
+		}
+
+		bool operator()(unsigned a, unsigned b) const
+		{
+			return centres[a][axis] < centres[b][axis];
+		}
+	};
+
+	void AddShape(const Matrix4& transform, const Vector3& size, unsigned kind, const AABB& box)
+	{
+		for (unsigned i = 0; i < 12; i++) shapes.push_back(transform.data[i]);
+		shapes.push_back(size.x);
+		shapes.push_back(size.y);
+		shapes.push_back(size.z);
+		shapes.push_back((real)kind);
+
+		bounds.push_back(box);
+	}
+
+	void AddCollider(Collider* collider, unsigned mask)
+	{
+		if (!(collider->collisionGroup & mask)) return;
+
+		switch (collider->colliderType)
+		{
+		case ColliderType::Box:
+			AddShape(collider->GetTransform(), static_cast<BoxCollider*>(collider)->halfSize, boxShape, collider->GetBoundingBox());
+			break;
+		case ColliderType::Sphere:
+		{
+			real radius = static_cast<SphereCollider*>(collider)->radius;
+			AddShape(collider->GetTransform(), Vector3(radius, radius, radius), sphereShape, collider->GetBoundingBox());
+			break;
+		}
+		case ColliderType::HalfSpace:
+		{
+			HalfSpaceCollider* plane = static_cast<HalfSpaceCollider*>(collider);
+			Vector3 normal = plane->GetWorldNormal();
+			planes.push_back(normal.x);
+			planes.push_back(normal.y);
+			planes.push_back(normal.z);
+			planes.push_back(plane->GetWorldDistance());
+			break;
+		}
+		case ColliderType::Compound:
+		{
+			CompoundCollider* compound = static_cast<CompoundCollider*>(collider);
+			for (unsigned i = 0; i < compound->GetChildCount(); i++)
+			{
+				AddCollider(compound->PlaceChild(compound->GetChild(i)), mask);
+			}
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	// Median split along the longest axis of the centres, builds the node at the back of the list
+	void BuildNode(unsigned begin, unsigned end)
+	{
+		unsigned index = (unsigned)nodes.size();
+		nodes.push_back(Node());
+
+		AABB box = bounds[order[begin]];
+		AABB centreBox(centres[order[begin]], centres[order[begin]]);
+		for (unsigned i = begin + 1; i < end; i++)
+		{
+			box = box.Merge(bounds[order[i]]);
+			centreBox = centreBox.Merge(AABB(centres[order[i]], centres[order[i]]));
+		}
+
+		nodes[index].box = box;
+
+		if (end - begin <= sensorLeafSize)
+		{
+			nodes[index].first = begin;
+			nodes[index].count = end - begin;
+			return;
+		}
+
+		Vector3 extent = centreBox.max - centreBox.min;
+		unsigned axis = 0;
+		if (extent.y > extent[axis]) axis = 1;
+		if (extent.z > extent[axis]) axis = 2;
+
+		unsigned middle = (begin + end) / 2;
+		std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end, CompareCentres(centres, axis));
+
+		nodes[index].axis = axis;
+		nodes[index].count = 0;
+
+		BuildNode(begin, middle);
+		nodes[index].secondChild = (unsigned)nodes.size();
+		BuildNode(middle, end);
+	}
+
+	// Lanes whose rays enter the box before their distance
+	static unsigned IntersectBounds(const RayPacket& packet, const AABB& box)
+	{
+#if defined(SENSOR_SCENE_AVX)
+
+		__m256d enter = _mm256_setzero_pd();
+		__m256d leave = _mm256_load_pd(packet.distance);
+
+		for (unsigned k = 0; k < 3; k++)
+		{
+			__m256d origin = _mm256_load_pd(packet.origin[k]);
+			__m256d inverse = _mm256_load_pd(packet.inverse[k]);
+
+			__m256d first = _mm256_mul_pd(_mm256_sub_pd(_mm256_set1_pd(box.min[k]), origin), inverse);
+			__m256d second = _mm256_mul_pd(_mm256_sub_pd(_mm256_set1_pd(box.max[k]), origin), inverse);
+
+			enter = _mm256_max_pd(enter, _mm256_min_pd(first, second));
+			leave = _mm256_min_pd(leave, _mm256_max_pd(first, second));
+		}
+
+		return (unsigned)_mm256_movemask_pd(_mm256_cmp_pd(enter, leave, _CMP_LE_OQ));
+
+#else
+
+		unsigned mask = 0;
+		for (unsigned lane = 0; lane < rayPacketSize; lane++)
+		{
+			Vector3 origin(packet.origin[0][lane], packet.origin[1][lane], packet.origin[2][lane]);
+			Vector3 inverse(packet.inverse[0][lane], packet.inverse[1][lane], packet.inverse[2][lane]);
+
+			real entry;
+			if (rayIntersectsBox(origin, inverse, packet.distance[lane], box, entry)) mask |= 1 << lane;
+		}
+		return mask;
+
+#endif
+	}
+
+	// Lowers the distance of the lanes that hit the shape closer, returns those lanes
+	static unsigned IntersectShape(RayPacket& packet, const real* shape)
+	{
+#if defined(SENSOR_SCENE_AVX)
+
+		__m256d distance = _mm256_load_pd(packet.distance);
+		__m256d origin[3], direction[3];
+		for (unsigned k = 0; k < 3; k++)
+		{
+			origin[k] = _mm256_sub_pd(_mm256_load_pd(packet.origin[k]), _mm256_set1_pd(shape[4 * k + 3]));
+			direction[k] = _mm256_load_pd(packet.direction[k]);
+		}
+
+		__m256d hit;
+
+		if (shape[15] == sphereShape)
+		{
+			__m256d b = _mm256_setzero_pd(), c = _mm256_set1_pd(-shape[12] * shape[12]);
+			for (unsigned k = 0; k < 3; k++)
+			{
+				b = _mm256_add_pd(b, _mm256_mul_pd(origin[k], direction[k]));
+				c = _mm256_add_pd(c, _mm256_mul_pd(origin[k], origin[k]));
+			}
+
+			// A negative discriminant gives NaN, which fails the ordered comparisons
+			__m256d t = _mm256_sub_pd(_mm256_sub_pd(_mm256_setzero_pd(), b),
+				_mm256_sqrt_pd(_mm256_sub_pd(_mm256_mul_pd(b, b), c)));
+
+			hit = _mm256_and_pd(
+				_mm256_and_pd(_mm256_cmp_pd(c, _mm256_setzero_pd(), _CMP_GT_OQ), _mm256_cmp_pd(t, _mm256_setzero_pd(), _CMP_GT_OQ)),
+				_mm256_cmp_pd(t, distance, _CMP_LT_OQ));
+
+			distance = _mm256_blendv_pd(distance, t, hit);
+		}
+		else
+		{
+			const __m256d signMask = _mm256_set1_pd(-0.0);
+			const __m256d tiny = _mm256_set1_pd((real)1e-30);
+
+			__m256d enter = _mm256_set1_pd(-REAL_MAX);
+			__m256d leave = _mm256_set1_pd(REAL_MAX);
+
+			for (unsigned k = 0; k < 3; k++)
+			{
+				// Matrix4::TransformInversePoint and TransformInverseDirection
+				__m256d localOrigin = _mm256_add_pd(_mm256_add_pd(
+					_mm256_mul_pd(origin[0], _mm256_set1_pd(shape[k])),
+					_mm256_mul_pd(origin[1], _mm256_set1_pd(shape[k + 4]))),
+					_mm256_mul_pd(origin[2], _mm256_set1_pd(shape[k + 8])));
+				__m256d localDirection = _mm256_add_pd(_mm256_add_pd(
+					_mm256_mul_pd(direction[0], _mm256_set1_pd(shape[k])),
+					_mm256_mul_pd(direction[1], _mm256_set1_pd(shape[k + 4]))),
+					_mm256_mul_pd(direction[2], _mm256_set1_pd(shape[k + 8])));
+
+				// Keeps the reciprocal finite for rays parallel to the slab, keeping the sign
+				__m256d small = _mm256_cmp_pd(_mm256_andnot_pd(signMask, localDirection), tiny, _CMP_LT_OQ);
+				localDirection = _mm256_blendv_pd(localDirection, _mm256_or_pd(tiny, _mm256_and_pd(signMask, localDirection)), small);
+				__m256d inverse = _mm256_div_pd(_mm256_set1_pd(1), localDirection);
+
+				__m256d half = _mm256_set1_pd(shape[12 + k]);
+				__m256d first = _mm256_mul_pd(_mm256_sub_pd(_mm256_xor_pd(half, signMask), localOrigin), inverse);
+				__m256d second = _mm256_mul_pd(_mm256_sub_pd(half, localOrigin), inverse);
+
+				enter = _mm256_max_pd(enter, _mm256_min_pd(first, second));
+				leave = _mm256_min_pd(leave, _mm256_max_pd(first, second));
+			}
+
+			hit = _mm256_and_pd(
+				_mm256_and_pd(_mm256_cmp_pd(enter, leave, _CMP_LE_OQ), _mm256_cmp_pd(enter, _mm256_setzero_pd(), _CMP_GT_OQ)),
+				_mm256_cmp_pd(enter, distance, _CMP_LT_OQ));
+
+			distance = _mm256_blendv_pd(distance, enter, hit);
+		}
+
+		_mm256_store_pd(packet.distance, distance);
+		return (unsigned)_mm256_movemask_pd(hit);
+
+#else
+
+		unsigned mask = 0;
+		for (unsigned lane = 0; lane < rayPacketSize; lane++)
+		{
+			real origin[3], direction[3];
+			for (unsigned k = 0; k < 3; k++)
+			{
+				origin[k] = packet.origin[k][lane] - shape[4 * k + 3];
+				direction[k] = packet.direction[k][lane];
+			}
+
+			real t;
+
+			if (shape[15] == sphereShape)
+			{
+				real b = origin[0] * direction[0] + origin[1] * direction[1] + origin[2] * direction[2];
+				real c = origin[0] * origin[0] + origin[1] * origin[1] + origin[2] * origin[2] - shape[12] * shape[12];
+				real discriminant = b * b - c;
+
+				if (c <= 0 || discriminant < 0) continue;
+				t = -b - real_sqrt(discriminant);
+			}
+			else
+			{
+				real enter = -REAL_MAX, leave = REAL_MAX;
+
+				for (unsigned k = 0; k < 3; k++)
+				{
+					real localOrigin = origin[0] * shape[k] + origin[1] * shape[k + 4] + origin[2] * shape[k + 8];
+					real localDirection = direction[0] * shape[k] + direction[1] * shape[k + 4] + direction[2] * shape[k + 8];
+
+					if (real_abs(localDirection) < (real)1e-30) localDirection = localDirection < 0 ? (real)-1e-30 : (real)1e-30;
+					real inverse = 1 / localDirection;
+
+					real first = (-shape[12 + k] - localOrigin) * inverse;
+					real second = (shape[12 + k] - localOrigin) * inverse;
+
+					enter = std::max(enter, std::min(first, second));
+					leave = std::min(leave, std::max(first, second));
+				}
+
+				if (enter > leave) continue;
+				t = enter;
+			}
+
+			if (t > 0 && t < packet.distance[lane])
+			{
+				packet.distance[lane] = t;
+				mask |= 1 << lane;
+			}
+		}
+		return mask;
+
+#endif
+	}
+
+	static unsigned IntersectPlane(RayPacket& packet, const real* plane)
+	{
+		unsigned mask = 0;
+
+		for (unsigned lane = 0; lane < rayPacketSize; lane++)
+		{
+			real height = -plane[3], speed = 0;
+			for (unsigned k = 0; k < 3; k++)
+			{
+				height += plane[k] * packet.origin[k][lane];
+				speed += plane[k] * packet.direction[k][lane];
+			}
+
+			if (height <= 0 || speed >= 0) continue;
+
+			real t = -height / speed;
+			if (t < packet.distance[lane])
+			{
+				packet.distance[lane] = t;
+				mask |= 1 << lane;
+			}
+		}
+
+		return mask;
+	}
+
+public:
+
+	// Copies the boxes, spheres and half spaces of the world whose collision group shares a bit with
+	// mask, including those inside compounds. Colliders are taken where the last step left them.
+	void Build(World& world, unsigned mask = 0xffffffff)
+	{
+		shapes.clear();
+		bounds.clear();
+		nodes.clear();
+		planes.clear();
+
+		for (unsigned i = 0; i < world.colliders.size(); i++) AddCollider(world.colliders[i], mask);
+		for (unsigned i = 0; i < world.staticColliders.size(); i++) AddCollider(world.staticColliders[i], mask);
+		for (unsigned i = 0; i < world.halfSpaces.size(); i++) AddCollider(world.halfSpaces[i], mask);
+
+		unsigned count = (unsigned)bounds.size();
+		if (count == 0) return;
+
+		order.resize(count);
+		centres.resize(count);
+		for (unsigned i = 0; i < count; i++)
+		{
+			order[i] = i;
+			centres[i] = bounds[i].GetCenter();
+		}
+
+		BuildNode(0, count);
+
+		// Store the shapes in leaf order so every leaf reads one contiguous run
+		sortedShapes.resize(shapes.size());
+		for (unsigned i = 0; i < count; i++)
+		{
+			std::copy(shapes.begin() + 16 * order[i], shapes.begin() + 16 * (order[i] + 1), sortedShapes.begin() + 16 * i);
+		}
+		shapes.swap(sortedShapes);
+	}
+
+	unsigned GetShapeCount() const
+	{
+		return (unsigned)shapes.size() / 16;
+	}
+
+	// Traces the packet, every lane's distance ends at its closest hit. Returns the lanes that hit.
+	unsigned Trace(RayPacket& packet) const
+	{
+		unsigned hits = 0;
+
+		// Planes first, a close floor shortens the rays before the tree is entered
+		for (unsigned i = 0; i < planes.size(); i += 4)
+		{
+			hits |= IntersectPlane(packet, &planes[i]);
+		}
+
+		if (nodes.empty()) return hits;
+
+		unsigned stack[sensorStackSize];
+		unsigned size = 0;
+		stack[size++] = 0;
+
+		while (size > 0)
+		{
+			const Node& node = nodes[stack[--size]];
+			if (!IntersectBounds(packet, node.box)) continue;
+
+			if (node.count > 0)
+			{
+				for (unsigned i = node.first; i < node.first + node.count; i++)
+				{
+					hits |= IntersectShape(packet, &shapes[16 * i]);
+				}
+				continue;
+			}
+
+			// Nearer child first for the first ray, the rays of a packet mostly agree
+			unsigned firstChild = (unsigned)(&node - &nodes[0]) + 1;
+			if (packet.direction[node.axis][0] < 0)
+			{
+				stack[size++] = firstChild;
+				stack[size++] = node.secondChild;
+			}
+			else
+			{
+				stack[size++] = node.secondChild;
+				stack[size++] = firstChild;
+			}
+		}
+
+		return hits;
+	}
+};
@@ -0,0 +1,338 @@
+#pragma once
+#include "Colliders.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SAT_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SAT_SSE2
+#endif
+
+
+#define boxBoxAxisCount 15
+#define boxBoxAxisSlots 16
+
+// Face axes of both boxes in structure of arrays form, [0..2] belong to one and [3..5] to two.
+// Axis i of a transform is the column (data[i], data[i + 4], data[i + 8]).
+static inline void boxBoxFaceAxes(const Matrix4& one, const Matrix4& two, real *x, real *y, real *z)
+{
+	for (unsigned i = 0; i < 3; i++)
+	{
+		x[i] = one.data[i]; y[i] = one.data[i + 4]; z[i] = one.data[i + 8];
+		x[i + 3] = two.data[i]; y[i + 3] = two.data[i + 4]; z[i + 3] = two.data[i + 8];
+	}
+}
+
+// Penetration of the boxes along a single candidate axis, the reference every SIMD lane matches.
+// Returns false when the axis is too short to be tested.
+static inline bool boxBoxPenetrationOnAxis(
+	real x, real y, real z,
+	const real *ax, const real *ay, const real *az,
+	const Vector3 &oneHalf,
+	const Vector3 &twoHalf,
+	const Vector3 &toCentre,
+	real &penetration
+)
+{
+	real square = x * x + y * y + z * z;
+	if (square < 0.0001) return false;
+
+	real length = real_sqrt(square);
+	x = x / length; y = y / length; z = z / length;
+
+	real project[2];
+	for (unsigned box = 0; box < 2; box++)
+	{
+		const Vector3& half = box ? twoHalf : oneHalf;
+		unsigned n = box * 3;
+
+		project[box] =
+			half.x * real_abs(x * ax[n] + y * ay[n] + z * az[n]) +
+			half.y * real_abs(x * ax[n + 1] + y * ay[n + 1] + z * az[n + 1]) +
+			half.z * real_abs(x * ax[n + 2] + y * ay[n + 2] + z * az[n + 2]);
+	}
+
+	real distance = real_abs(x * toCentre.x + y * toCentre.y + z * toCentre.z);
+	penetration = project[0] + project[1] - distance;
+	return true;
+}
+
+// The 15 candidate axes of a box pair in structure of arrays form, the last slot is a zero
+// padding axis so the lanes divide evenly
+class BoxBoxAxes
+{
+public:
+
+	alignas(32) real x[boxBoxAxisSlots];
+	alignas(32) real y[boxBoxAxisSlots];
+	alignas(32) real z[boxBoxAxisSlots];
+
+	// Penetration per axis, REAL_MAX for the axes that are too short to test
+	alignas(32) real penetration[boxBoxAxisSlots];
+
+	BoxBoxAxes(const Matrix4& one, const Matrix4& two)
+	{
+		boxBoxFaceAxes(one, two, x, y, z);
+
+		// Same operation order as Vector3::operator%
+		for (unsigned i = 0; i < 3; i++)
+		for (unsigned j = 0; j < 3; j++)
+		{
+			unsigned k = 6 + i * 3 + j;
+			x[k] = y[i] * z[j + 3] - z[i] * y[j + 3];
+			y[k] = z[i] * x[j + 3] - x[i] * z[j + 3];
+			z[k] = x[i] * y[j + 3] - y[i] * x[j + 3];
+		}
+
+		x[15] = y[15] = z[15] = 0;
+	}
+};
+
+
+// Projects every candidate axis at once. Each lane performs the operations of
+// boxBoxPenetrationOnAxis in the same order, so the penetrations are bit identical whichever path
+// is compiled. Returns the mask of the axes that separate the boxes, when it is zero the smallest
+// penetration is filled.
+static inline unsigned boxBoxPenetrations(
+	BoxBoxAxes &axes,
+	const BoxCollider &one,
+	const BoxCollider &two,
+	const Vector3 &toCentre,
+	real &smallest
+)
+{
+	const real *a = axes.x, *b = axes.y, *c = axes.z;
+	const Vector3 oneHalf = one.halfSize, twoHalf = two.halfSize;
+
+	// Box axes broadcast per component
+	const real *ax = a, *ay = b, *az = c;
+
+#if defined(SAT_AVX)
+
+	const __m256d signMask = _mm256_set1_pd(-0.0);
+	const __m256d epsilon = _mm256_set1_pd(0.0001);
+	const __m256d zero = _mm256_setzero_pd();
+	const __m256d none = _mm256_set1_pd(REAL_MAX);
+
+	unsigned separated = 0;
+	__m256d minimum = none;
+
+	for (unsigned i = 0; i < boxBoxAxisSlots; i += 4)
+	{
+		__m256d x = _mm256_load_pd(a + i), y = _mm256_load_pd(b + i), z = _mm256_load_pd(c + i);
+
+		__m256d square = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(x, x), _mm256_mul_pd(y, y)), _mm256_mul_pd(z, z));
+		__m256d tested = _mm256_cmp_pd(square, epsilon, _CMP_NLT_UQ);
+
+		__m256d length = _mm256_sqrt_pd(square);
+		x = _mm256_div_pd(x, length); y = _mm256_div_pd(y, length); z = _mm256_div_pd(z, length);
+
+		__m256d project[2];
+		for (unsigned box = 0; box < 2; box++)
+		{
+			const Vector3& half = box ? twoHalf : oneHalf;
+			__m256d sum = zero;
+
+			for (unsigned k = 0; k < 3; k++)
+			{
+				unsigned n = box * 3 + k;
+				__m256d dot = _mm256_add_pd(_mm256_add_pd(
+					_mm256_mul_pd(x, _mm256_set1_pd(ax[n])),
+					_mm256_mul_pd(y, _mm256_set1_pd(ay[n]))),
+					_mm256_mul_pd(z, _mm256_set1_pd(az[n])));
+
+				__m256d term = _mm256_mul_pd(_mm256_set1_pd(half[k]), _mm256_andnot_pd(signMask, dot));
+				sum = k ? _mm256_add_pd(sum, term) : term;
+			}
+			project[box] = sum;
+		}
+
+		__m256d distance = _mm256_andnot_pd(signMask, _mm256_add_pd(_mm256_add_pd(
+			_mm256_mul_pd(x, _mm256_set1_pd(toCentre.x)),
+			_mm256_mul_pd(y, _mm256_set1_pd(toCentre.y))),
+			_mm256_mul_pd(z, _mm256_set1_pd(toCentre.z))));
+
+		__m256d penetration = _mm256_sub_pd(_mm256_add_pd(project[0], project[1]), distance);
+
+		separated |= (unsigned)_mm256_movemask_pd(_mm256_and_pd(tested, _mm256_cmp_pd(penetration, zero, _CMP_LT_OQ))) << i;
+
+		// Untested axes and NaN never become the best axis, exactly like the scalar comparisons
+		__m256d usable = _mm256_and_pd(tested, _mm256_cmp_pd(penetration, zero, _CMP_GE_OQ));
+		penetration = _mm256_blendv_pd(none, penetration, usable);
+		minimum = _mm256_min_pd(minimum, penetration);
+		_mm256_store_pd(axes.penetration + i, penetration);
+	}
+
+	__m128d lower = _mm_min_pd(_mm256_castpd256_pd128(minimum), _mm256_extractf128_pd(minimum, 1));
+	smallest = _mm_cvtsd_f64(_mm_min_sd(lower, _mm_unpackhi_pd(lower, lower)));
+
+	return separated;
+
+#elif defined(SAT_SSE2)
+
+	const __m128d signMask = _mm_set1_pd(-0.0);
+	const __m128d epsilon = _mm_set1_pd(0.0001);
+	const __m128d zero = _mm_setzero_pd();
+	const __m128d none = _mm_set1_pd(REAL_MAX);
+
+	unsigned separated = 0;
+	__m128d minimum = none;
+
+	for (unsigned i = 0; i < boxBoxAxisSlots; i += 2)
+	{
+		__m128d x = _mm_load_pd(a + i), y = _mm_load_pd(b + i), z = _mm_load_pd(c + i);
+
+		__m128d square = _mm_add_pd(_mm_add_pd(_mm_mul_pd(x, x), _mm_mul_pd(y, y)), _mm_mul_pd(z, z));
+		__m128d tested = _mm_cmpnlt_pd(square, epsilon);
+
+		__m128d length = _mm_sqrt_pd(square);
+		x = _mm_div_pd(x, length); y = _mm_div_pd(y, length); z = _mm_div_pd(z, length);
+
+		__m128d project[2];
+		for (unsigned box = 0; box < 2; box++)
+		{
+			const Vector3& half = box ? twoHalf : oneHalf;
+			__m128d sum = zero;
+
+			for (unsigned k = 0; k < 3; k++)
+			{
+				unsigned n = box * 3 + k;
+				__m128d dot = _mm_add_pd(_mm_add_pd(
+					_mm_mul_pd(x, _mm_set1_pd(ax[n])),
+					_mm_mul_pd(y, _mm_set1_pd(ay[n]))),
+					_mm_mul_pd(z, _mm_set1_pd(az[n])));
+
+				__m128d term = _mm_mul_pd(_mm_set1_pd(half[k]), _mm_andnot_pd(signMask, dot));
+				sum = k ? _mm_add_pd(sum, term) : term;
+			}
+			project[box] = sum;
+		}
+
+		__m128d distance = _mm_andnot_pd(signMask, _mm_add_pd(_mm_add_pd(
+			_mm_mul_pd(x, _mm_set1_pd(toCentre.x)),
+			_mm_mul_pd(y, _mm_set1_pd(toCentre.y))),
+			_mm_mul_pd(z, _mm_set1_pd(toCentre.z))));
+
+		__m128d penetration = _mm_sub_pd(_mm_add_pd(project[0], project[1]), distance);
+
+		separated |= (unsigned)_mm_movemask_pd(_mm_and_pd(tested, _mm_cmplt_pd(penetration, zero))) << i;
+
+		__m128d usable = _mm_and_pd(tested, _mm_cmpge_pd(penetration, zero));
+		penetration = _mm_or_pd(_mm_and_pd(usable, penetration), _mm_andnot_pd(usable, none));
+		minimum = _mm_min_pd(minimum, penetration);
+		_mm_store_pd(axes.penetration + i, penetration);
+	}
+
+	smallest = _mm_cvtsd_f64(_mm_min_sd(minimum, _mm_unpackhi_pd(minimum, minimum)));
+
+	return separated;
+
+#else
+
+	unsigned separated = 0;
+	smallest = REAL_MAX;
+
+	for (unsigned i = 0; i < boxBoxAxisSlots; i++)
+	{
+		real penetration;
+		if (!boxBoxPenetrationOnAxis(a[i], b[i], c[i], ax, ay, az, oneHalf, twoHalf, toCentre, penetration))
+		{
+			axes.penetration[i] = REAL_MAX;
+			continue;
+		}
+
+		if (penetration < 0) separated |= 1u << i;
+		axes.penetration[i] = penetration >= 0 ? penetration : REAL_MAX;
+		if (axes.penetration[i] < smallest) smallest = axes.penetration[i];
+	}
+
+	return separated;
+
+#endif
+}
+
+// Tests only the given axis, true when it separates the boxes
+static inline bool boxBoxSeparatedOnAxis(
+	const BoxCollider &one,
+	const BoxCollider &two,
+	const Vector3 &toCentre,
+	unsigned index
+)
+{
+	real x[6], y[6], z[6];
+	boxBoxFaceAxes(one.GetTransform(), two.GetTransform(), x, y, z);
+
+	Vector3 axis;
+	if (index < 6)
+	{
+		axis = Vector3(x[index], y[index], z[index]);
+	}
+	else
+	{
+		unsigned i = (index - 6) / 3, j = (index - 6) % 3 + 3;
+		axis = Vector3(x[i], y[i], z[i]) % Vector3(x[j], y[j], z[j]);
+	}
+
+	real penetration;
+	if (!boxBoxPenetrationOnAxis(axis.x, axis.y, axis.z, x, y, z, one.halfSize, two.halfSize, toCentre, penetration)) return false;
+
+	return penetration < 0;
+}
+
+// Separating axis test of two boxes. Fills the smallest penetration and its axis index
+// (0-2 faces of one, 3-5 faces of two, 6-14 edge pairs) and the best face axis, ties go to
+// the lowest index. Returns false when the boxes are apart.
+//
+// lastAxis carries the result between steps: the axis it names is tried on its own first, since
+// boxes that were apart usually still are along the same axis. It is then set to the separating
+// axis, or to the smallest penetration axis when the boxes touch.
+static inline bool boxBoxSeparatingAxes(
+	const BoxCollider &one,
+	const BoxCollider &two,
+	const Vector3 &toCentre,
+	real &smallestPenetration,
+	unsigned &smallestCase,
+	unsigned &smallestFaceCase,
+	unsigned &lastAxis
+)
+{
+	if (lastAxis < boxBoxAxisCount && boxBoxSeparatedOnAxis(one, two, toCentre, lastAxis)) return false;
+
+	BoxBoxAxes axes(one.GetTransform(), two.GetTransform());
+
+	unsigned separated = boxBoxPenetrations(axes, one, two, toCentre, smallestPenetration);
+	if (separated)
+	{
+		lastAxis = 0;
+		while (!(separated & (1u << lastAxis))) lastAxis++;
+		return false;
+	}
+
+	smallestCase = 0xffffff;
+	smallestFaceCase = 0xffffff;
+
+	if (smallestPenetration == REAL_MAX) return true;
+
+	for (unsigned i = 0; i < boxBoxAxisCount; i++)
+	{
+		if (axes.penetration[i] == smallestPenetration)
+		{
+			smallestCase = i;
+			break;
+		}
+	}
+
+	real smallestFace = REAL_MAX;
+	for (unsigned i = 0; i < 6; i++)
+	{
+		if (axes.penetration[i] < smallestFace)
+		{
+			smallestFace = axes.penetration[i];
+			smallestFaceCase = i;
+		}
+	}
+
+	lastAxis = smallestCase;
+	return true;
+}
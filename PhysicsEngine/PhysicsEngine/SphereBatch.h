@@ -0,0 +1,168 @@
+#pragma once
+#include "Colliders.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SPHERE_BATCH_AVX
+#endif
+
+
+// Contact of a candidate pair of a batched test, pair is the pair's index in the candidate arrays.
+// Filled exactly like the contact of the matching CollisionDetector routine.
+class SphereContact
+{
+public:
+
+	unsigned pair;
+
+	Vector3 contactNormal;
+	Vector3 contactPoint;
+	real penetration;
+};
+
+
+// Sphere centres and radii packed for testing large numbers of sphere pairs (granular material)
+// without going through the colliders one pair at a time. Each sphere is one (x, y, z, radius)
+// record, since the candidate pairs index arbitrary spheres and a record is a single load.
+class SphereBatch
+{
+	std::vector<real> spheres;
+
+public:
+
+	void Clear()
+	{
+		spheres.clear();
+	}
+
+	unsigned Size() const
+	{
+		return (unsigned)spheres.size() / 4;
+	}
+
+	// Returns the index of the sphere in the batch
+	unsigned Add(const Vector3& centre, real radius)
+	{
+		spheres.push_back(centre.x);
+		spheres.push_back(centre.y);
+		spheres.push_back(centre.z);
+		spheres.push_back(radius);
+
+		return Size() - 1;
+	}
+
+	unsigned Add(const SphereCollider* sphere)
+	{
+		return Add(sphere->GetAxis(3), sphere->radius);
+	}
+
+	void Set(unsigned index, const Vector3& centre, real radius)
+	{
+		real* sphere = &spheres[4 * index];
+		sphere[0] = centre.x;
+		sphere[1] = centre.y;
+		sphere[2] = centre.z;
+		sphere[3] = radius;
+	}
+
+	Vector3 GetCentre(unsigned index) const
+	{
+		const real* sphere = &spheres[4 * index];
+		return Vector3(sphere[0], sphere[1], sphere[2]);
+	}
+
+	real GetRadius(unsigned index) const
+	{
+		return spheres[4 * index + 3];
+	}
+
+	// The (x, y, z, radius) records of all spheres
+	const real* GetData() const
+	{
+		return spheres.empty() ? NULL : &spheres[0];
+	}
+
+	// Tests the candidate pairs (one[i], two[i]) and writes a contact for every pair that touches,
+	// packed at the front of contacts, which must have room for count entries. Returns the number
+	// of contacts. The square root is only taken for the pairs that pass the squared distance test.
+	unsigned DetectCollisions(const unsigned* one, const unsigned* two, unsigned count, SphereContact* contacts) const
+	{
+		const real* data = GetData();
+
+		unsigned hits = 0;
+		unsigned i = 0;
+
+#if defined(SPHERE_BATCH_AVX)
+
+		// Flipping the sign of the second radius turns one - two into (dx, dy, dz, radius sum).
+		// After squaring, the last lane is negated and widened slightly so that the horizontal sum
+		// is below zero for every pair the exact test below can accept.
+		const __m256d flip = _mm256_set_pd(-0.0, 0, 0, 0);
+		const __m256d scale = _mm256_set_pd(-(1 + (real)1e-9), 1, 1, 1);
+
+		for (; i + 4 <= count; i += 4)
+		{
+			__m256d d0 = _mm256_sub_pd(_mm256_loadu_pd(data + 4 * one[i]), _mm256_xor_pd(_mm256_loadu_pd(data + 4 * two[i]), flip));
+			__m256d d1 = _mm256_sub_pd(_mm256_loadu_pd(data + 4 * one[i + 1]), _mm256_xor_pd(_mm256_loadu_pd(data + 4 * two[i + 1]), flip));
+			__m256d d2 = _mm256_sub_pd(_mm256_loadu_pd(data + 4 * one[i + 2]), _mm256_xor_pd(_mm256_loadu_pd(data + 4 * two[i + 2]), flip));
+			__m256d d3 = _mm256_sub_pd(_mm256_loadu_pd(data + 4 * one[i + 3]), _mm256_xor_pd(_mm256_loadu_pd(data + 4 * two[i + 3]), flip));
+
+			d0 = _mm256_mul_pd(_mm256_mul_pd(d0, d0), scale);
+			d1 = _mm256_mul_pd(_mm256_mul_pd(d1, d1), scale);
+			d2 = _mm256_mul_pd(_mm256_mul_pd(d2, d2), scale);
+			d3 = _mm256_mul_pd(_mm256_mul_pd(d3, d3), scale);
+
+			__m256d low = _mm256_hadd_pd(d0, d1);
+			__m256d high = _mm256_hadd_pd(d2, d3);
+			__m256d sum = _mm256_add_pd(
+				_mm256_permute2f128_pd(low, high, 0x20),
+				_mm256_permute2f128_pd(low, high, 0x31));
+
+			unsigned mask = (unsigned)_mm256_movemask_pd(_mm256_cmp_pd(sum, _mm256_setzero_pd(), _CMP_LT_OQ));
+
+			for (unsigned k = 0; mask; k++, mask >>= 1)
+			{
+				if (mask & 1) contacts[hits++].pair = i + k;
+			}
+		}
+
+#endif
+
+		for (; i < count; i++)
+		{
+			const real* a = data + 4 * one[i];
+			const real* b = data + 4 * two[i];
+
+			real dx = a[0] - b[0];
+			real dy = a[1] - b[1];
+			real dz = a[2] - b[2];
+			real sum = a[3] + b[3];
+
+			contacts[hits].pair = i;
+			hits += (dx * dx + dy * dy + dz * dz < sum * sum * (1 + (real)1e-9)) ? 1 : 0;
+		}
+
+		// Second pass over the hits only, same arithmetic as the per pair routine
+		unsigned written = 0;
+		for (unsigned h = 0; h < hits; h++)
+		{
+			unsigned pair = contacts[h].pair;
+			unsigned a = one[pair], b = two[pair];
+
+			Vector3 positionOne = GetCentre(a);
+			Vector3 midline = positionOne - GetCentre(b);
+			real size = midline.Magnitude();
+			real sum = GetRadius(a) + GetRadius(b);
+
+			if (size <= 0 || size >= sum) continue;
+
+			SphereContact& contact = contacts[written++];
+			contact.pair = pair;
+			contact.contactNormal = midline * ((real)1 / size);
+			contact.contactPoint = positionOne + midline * (real)0.5;
+			contact.penetration = sum - size;
+		}
+
+		return written;
+	}
+};
@@ -0,0 +1,187 @@
+#pragma once
+#include "Broadphase.h"
+
+
+// Sort and sweep along a single axis. The endpoint order of the previous step is kept,
+// so with coherent motion the insertion sort in Update only performs a few swaps.
+class SweepAndPruneBroadphase : public Broadphase
+{
+	class Entry
+	{
+	public:
+
+		real min;
+		real max;
+		AABB box;
+		Collider* collider;
+	};
+
+	std::vector<Entry> entries;
+
+	unsigned axis = 0;
+	unsigned nextAxis = 0;
+
+	static bool CompareEntries(const Entry& a, const Entry& b)
+	{
+		return a.min < b.min;
+	}
+
+	void InsertionSort()
+	{
+		for (unsigned i = 1; i < entries.size(); i++)
+		{
+			if (entries[i - 1].min <= entries[i].min) continue;
+
+			Entry entry = entries[i];
+			unsigned j = i;
+			while (j > 0 && entries[j - 1].min > entry.min)
+			{
+				entries[j] = entries[j - 1];
+				j--;
+			}
+			entries[j] = entry;
+		}
+	}
+
+public:
+
+	void Add(Collider* collider)
+	{
+		Entry entry;
+		entry.box = collider->GetBoundingBox();
+		entry.min = entry.box.min[axis];
+		entry.max = entry.box.max[axis];
+		entry.collider = collider;
+
+		collider->broadphaseProxy = 0;
+		entries.push_back(entry);
+	}
+
+	void Remove(Collider* collider)
+	{
+		for (unsigned i = 0; i < entries.size(); i++)
+		{
+			if (entries[i].collider == collider)
+			{
+				entries.erase(entries.begin() + i);
+				collider->broadphaseProxy = -1;
+				return;
+			}
+		}
+	}
+
+	void Update()
+	{
+		bool axisChanged = axis != nextAxis;
+		axis = nextAxis;
+
+		for (unsigned i = 0; i < entries.size(); i++)
+		{
+			Entry& entry = entries[i];
+			entry.box = entry.collider->GetBoundingBox();
+			entry.min = entry.box.min[axis];
+			entry.max = entry.box.max[axis];
+		}
+
+		if (axisChanged)
+			std::sort(entries.begin(), entries.end(), CompareEntries);
+		else
+			InsertionSort();
+	}
+
+	void FindPairs(std::vector<ColliderPair>& pairs)
+	{
+		Vector3 sum, sumSquares;
+
+		for (unsigned i = 0; i < entries.size(); i++)
+		{
+			const Entry& entry = entries[i];
+
+			Vector3 center = entry.box.GetCenter();
+			sum += center;
+			sumSquares += Vector3(center.x * center.x, center.y * center.y, center.z * center.z);
+
+			for (unsigned j = i + 1; j < entries.size(); j++)
+			{
+				const Entry& other = entries[j];
+				if (other.min > entry.max) break;
+
+				if (entry.box.Overlaps(other.box))
+				{
+					AddPair(pairs, entry.collider, other.collider);
+				}
+			}
+		}
+
+		// Sweep next step along the axis the centres are most spread on, with some slack
+		// so that a resort is not triggered every step when two axes are close
+		if (entries.size() > 1)
+		{
+			Vector3 variance = sumSquares - sum.ComponentProduct(sum) * ((real)1 / entries.size());
+
+			unsigned best = 0;
+			if (variance.y > variance[best]) best = 1;
+			if (variance.z > variance[best]) best = 2;
+
+			if (variance[best] > variance[axis] * (real)1.5) nextAxis = best;
+		}
+	}
+
+	// Only the entries whose interval on the sweep axis meets the ray's are slab tested, the sorted
+	// order ends the walk at the first entry starting past the ray
+	real QueryRay(const Ray& ray, RayQueryCallback& callback)
+	{
+		Vector3 inverse = inverseDirection(ray.direction);
+		real maxDistance = ray.maxDistance;
+
+		real start = ray.origin[axis];
+		real direction = ray.direction[axis];
+
+		for (unsigned i = 0; i < entries.size(); i++)
+		{
+			const Entry& entry = entries[i];
+
+			real end = start + direction * maxDistance;
+			if (entry.min > std::max(start, end) + ray.extent[axis]) break;
+			if (entry.max < std::min(start, end) - ray.extent[axis]) continue;
+
+			real distance;
+			if (rayIntersectsBox(ray.origin, inverse, maxDistance, entry.box, ray.extent, distance))
+			{
+				maxDistance = callback.ReportCollider(entry.collider, maxDistance);
+			}
+		}
+
+		return maxDistance;
+	}
+
+	bool Query(const AABB& box, OverlapCallback& callback)
+	{
+		for (unsigned i = 0; i < entries.size(); i++)
+		{
+			const Entry& entry = entries[i];
+			if (entry.min > box.max[axis]) break;
+
+			if (entry.box.Overlaps(box) && !callback.ReportCollider(entry.collider)) return false;
+		}
+
+		return true;
+	}
+
+	// Entries starting past the point by more than maxDistance along the sweep axis end the walk
+	real QueryNearest(const Vector3& point, real maxDistance, NearestCallback& callback)
+	{
+		for (unsigned i = 0; i < entries.size(); i++)
+		{
+			const Entry& entry = entries[i];
+			if (entry.min > point[axis] + maxDistance) break;
+
+			if (distanceToBox(point, entry.box) <= maxDistance)
+			{
+				maxDistance = callback.ReportCollider(entry.collider, maxDistance);
+			}
+		}
+
+		return maxDistance;
+	}
+};
@@ -0,0 +1,587 @@
+#pragma once
+#include "Ray.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <limits.h>
+
+#define triangleMeshVersion 1
+
+// Smallest extent an axis is quantized over, so that a flat mesh still gets a finite nonzero scale
+#define minQuantizedExtent 1e-4f
+
+
+// Whether edge j of the triangle, from its vertex j to vertex j + 1, is active. An edge is active when
+// the neighbouring triangle, whose far vertex is opposite, bends away convexly. Edges inside flat or
+// concave parts of a surface are not, nothing should be pushed off a triangle across one.
+static inline bool isActiveEdge(const Vector3* triangle, unsigned j, const Vector3& opposite)
+{
+	const Vector3& start = triangle[j];
+	const Vector3& end = triangle[(j + 1) % 3];
+
+	Vector3 normal = (triangle[1] - triangle[0]) % (triangle[2] - triangle[0]);
+	Vector3 otherNormal = (start - end) % (opposite - end);
+
+	real lengths = real_sqrt(normal.SquareMagnitude() * otherNormal.SquareMagnitude());
+
+	// The neighbour dips below this triangle's plane and the two are not nearly coplanar
+	return normal * (opposite - start) < 0 && normal * otherNormal < lengths * (real)0.999;
+}
+
+// Moller-Trumbore test from either side, distance is where the ray meets the triangle
+static inline bool rayIntersectsTriangle(
+	const Vector3& origin, const Vector3& direction, real maxDistance,
+	const Vector3& a, const Vector3& b, const Vector3& c, real& distance)
+{
+	Vector3 edge1 = b - a;
+	Vector3 edge2 = c - a;
+
+	Vector3 p = direction % edge2;
+	real determinant = edge1 * p;
+	if (real_abs(determinant) < (real)1e-12) return false;
+
+	real inverse = 1 / determinant;
+	Vector3 s = origin - a;
+
+	real u = (s * p) * inverse;
+	if (u < 0 || u > 1) return false;
+
+	Vector3 q = s % edge1;
+	real v = (direction * q) * inverse;
+	if (v < 0 || u + v > 1) return false;
+
+	real t = (edge2 * q) * inverse;
+	if (t < 0 || t > maxDistance) return false;
+
+	distance = t;
+	return true;
+}
+
+
+// Node of the quantized tree, 16 bytes. Nodes are stored depth first, every inner node is followed
+// by its left subtree and then its right one, and every leaf holds one triangle. For a leaf index is
+// the triangle, for an inner node it is minus the size of its subtree, so a traversal that misses
+// the node's box skips straight past the subtree and no stack is needed.
+class QuantizedNode
+{
+public:
+
+	unsigned short min[3];
+	unsigned short max[3];
+	int index;
+};
+
+
+// Start of a mesh file. It is followed by the vertices as x, y, z floats, the triangles as three
+// vertex indices each, the nodes and one byte of edge flags per triangle. Everything is in the byte
+// order of the machine that built it.
+class TriangleMeshHeader
+{
+public:
+
+	char magic[4];
+	unsigned version;
+	unsigned vertexCount;
+	unsigned triangleCount;
+	unsigned nodeCount;
+	float boundsMin[3];
+	float boundsMax[3];
+	float quantization[3];
+};
+
+
+// Triangles of static level geometry with a quantized bounding volume tree over them. A built mesh
+// keeps its bytes in exactly the layout of the file, so saving is one write and loading maps the file
+// and points into it, without parsing or allocating.
+class TriangleMeshData
+{
+	// Stored as unsigned so the nodes and floats are aligned, unused when the mesh is mapped
+	std::vector<unsigned> storage;
+	MappedFile file;
+
+	const TriangleMeshHeader* header;
+	const float* vertices;
+	const unsigned* indices;
+	const QuantizedNode* nodes;
+	const unsigned char* edgeFlags;
+
+	// In 64 bits so the counts of a corrupt header cannot wrap it around on a 32 bit build
+	static unsigned long long GetFileSize(unsigned vertexCount, unsigned triangleCount, unsigned nodeCount)
+	{
+		return sizeof(TriangleMeshHeader) + (unsigned long long)vertexCount * 3 * sizeof(float) +
+			(unsigned long long)triangleCount * 3 * sizeof(unsigned) + (unsigned long long)nodeCount * sizeof(QuantizedNode) + triangleCount;
+	}
+
+	// One pass over an attached file checking everything the queries index with: the tree has one
+	// leaf per triangle, leaves name existing triangles, every skip stays inside the tree and the
+	// triangles name existing vertices. The quantization must be finite and nonzero for queries to
+	// convert boxes and rays.
+	bool IsValid() const
+	{
+		unsigned triangleCount = header->triangleCount;
+		unsigned nodeCount = header->nodeCount;
+
+		if ((unsigned long long)nodeCount != (triangleCount ? 2ull * triangleCount - 1 : 0)) return false;
+
+		for (unsigned k = 0; k < 3; k++)
+		{
+			if (!(header->boundsMin[k] <= header->boundsMax[k]) || !(header->quantization[k] > 0) ||
+				header->boundsMax[k] - header->boundsMin[k] > FLT_MAX || header->quantization[k] > FLT_MAX)
+				return false;
+		}
+
+		for (unsigned i = 0; i < 3 * triangleCount; i++)
+		{
+			if (indices[i] >= header->vertexCount) return false;
+		}
+
+		for (unsigned i = 0; i < nodeCount; i++)
+		{
+			int index = nodes[i].index;
+
+			if (index >= 0)
+			{
+				if ((unsigned)index >= triangleCount) return false;
+			}
+			else
+			{
+				// An inner node covers itself and at least two leaves
+				if (index == INT_MIN || -index < 3 || (unsigned)-index > nodeCount - i) return false;
+			}
+		}
+
+		return true;
+	}
+
+	void Attach(const void* data)
+	{
+		const char* bytes = static_cast<const char*>(data);
+
+		header = reinterpret_cast<const TriangleMeshHeader*>(bytes);
+		bytes += sizeof(TriangleMeshHeader);
+
+		vertices = reinterpret_cast<const float*>(bytes);
+		bytes += (size_t)header->vertexCount * 3 * sizeof(float);
+
+		indices = reinterpret_cast<const unsigned*>(bytes);
+		bytes += (size_t)header->triangleCount * 3 * sizeof(unsigned);
+
+		nodes = reinterpret_cast<const QuantizedNode*>(bytes);
+		bytes += (size_t)header->nodeCount * sizeof(QuantizedNode);
+
+		edgeFlags = reinterpret_cast<const unsigned char*>(bytes);
+	}
+
+	// Edge j of a triangle runs from its vertex j to vertex j + 1, it is keyed by its two vertices
+	class EdgeEntry
+	{
+	public:
+
+		unsigned long long key;
+		unsigned triangle;
+		unsigned edge;
+
+		bool operator<(const EdgeEntry& other) const
+		{
+			return key < other.key;
+		}
+	};
+
+	// Edges on the boundary of the mesh, shared by more than two triangles or bending away are active
+	void FindActiveEdges()
+	{
+		unsigned triangleCount = header->triangleCount;
+		unsigned char* flags = const_cast<unsigned char*>(edgeFlags);
+
+		std::vector<EdgeEntry> edges(3 * triangleCount);
+		for (unsigned t = 0; t < triangleCount; t++)
+		{
+			for (unsigned j = 0; j < 3; j++)
+			{
+				unsigned a = indices[3 * t + j], b = indices[3 * t + (j + 1) % 3];
+				if (a > b) std::swap(a, b);
+
+				EdgeEntry& entry = edges[3 * t + j];
+				entry.key = ((unsigned long long)a << 32) | b;
+				entry.triangle = t;
+				entry.edge = j;
+			}
+
+			flags[t] = 0;
+		}
+
+		std::sort(edges.begin(), edges.end());
+
+		for (unsigned begin = 0, end; begin < edges.size(); begin = end)
+		{
+			for (end = begin + 1; end < edges.size() && edges[end].key == edges[begin].key; end++);
+
+			if (end - begin != 2)
+			{
+				for (unsigned i = begin; i < end; i++) flags[edges[i].triangle] |= 1 << edges[i].edge;
+				continue;
+			}
+
+			const EdgeEntry& one = edges[begin];
+			const EdgeEntry& two = edges[begin + 1];
+
+			Vector3 corners[3], others[3];
+			GetTriangle(one.triangle, corners[0], corners[1], corners[2]);
+			GetTriangle(two.triangle, others[0], others[1], others[2]);
+
+			if (isActiveEdge(corners, one.edge, others[(two.edge + 2) % 3]))
+			{
+				flags[one.triangle] |= 1 << one.edge;
+				flags[two.triangle] |= 1 << two.edge;
+			}
+		}
+	}
+
+	class CompareCentroids
+	{
+		const std::vector<Vector3>& centroids;
+		unsigned axis;
+
+	public:
+
+		CompareCentroids(const std::vector<Vector3>& centroids, unsigned axis) : centroids(centroids), axis(axis) {}
+
+		bool operator()(unsigned a, unsigned b) const
+		{
+			return centroids[a][axis] < centroids[b][axis];
+		}
+	};
+
+	void Quantize(const Vector3& point, bool roundUp, unsigned short* out) const
+	{
+		for (unsigned i = 0; i < 3; i++)
+		{
+			real value = (point[i] - header->boundsMin[i]) * header->quantization[i];
+			value = roundUp ? ceil(value) : floor(value);
+
+			if (value < 0) value = 0;
+			if (value > 65535) value = 65535;
+			out[i] = (unsigned short)value;
+		}
+	}
+
+	// Builds the subtree of the triangles order[begin .. end) at node next, returns the node's index
+	unsigned BuildNode(
+		std::vector<unsigned>& order,
+		unsigned begin,
+		unsigned end,
+		const std::vector<Vector3>& centroids,
+		const std::vector<QuantizedNode>& leaves,
+		QuantizedNode* tree,
+		unsigned& next
+	)
+	{
+		unsigned index = next++;
+		QuantizedNode& node = tree[index];
+
+		if (end - begin == 1)
+		{
+			node = leaves[order[begin]];
+			return index;
+		}
+
+		Vector3 low = centroids[order[begin]], high = low;
+		for (unsigned i = begin + 1; i < end; i++)
+		{
+			const Vector3& c = centroids[order[i]];
+			for (unsigned k = 0; k < 3; k++)
+			{
+				if (c[k] < low[k]) low[k] = c[k];
+				if (c[k] > high[k]) high[k] = c[k];
+			}
+		}
+
+		Vector3 extent = high - low;
+		unsigned axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+		// Median split, which keeps the tree balanced whatever the triangle sizes
+		unsigned middle = (begin + end) / 2;
+		std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+			CompareCentroids(centroids, axis));
+
+		unsigned left = BuildNode(order, begin, middle, centroids, leaves, tree, next);
+		unsigned right = BuildNode(order, middle, end, centroids, leaves, tree, next);
+
+		for (unsigned k = 0; k < 3; k++)
+		{
+			node.min[k] = std::min(tree[left].min[k], tree[right].min[k]);
+			node.max[k] = std::max(tree[left].max[k], tree[right].max[k]);
+		}
+		node.index = -(int)(next - index);
+
+		return index;
+	}
+
+public:
+
+	TriangleMeshData() : header(NULL), vertices(NULL), indices(NULL), nodes(NULL), edgeFlags(NULL)
+	{
+
+	}
+
+	// Builds the mesh from vertex positions and three vertex indices per triangle
+	void Build(const std::vector<Vector3>& points, const std::vector<unsigned>& triangles)
+	{
+		file.Close();
+
+		unsigned vertexCount = (unsigned)points.size();
+		unsigned triangleCount = (unsigned)triangles.size() / 3;
+		unsigned nodeCount = triangleCount ? 2 * triangleCount - 1 : 0;
+
+		storage.assign((size_t)((GetFileSize(vertexCount, triangleCount, nodeCount) + sizeof(unsigned) - 1) / sizeof(unsigned)), 0);
+
+		TriangleMeshHeader* target = reinterpret_cast<TriangleMeshHeader*>(&storage[0]);
+		memcpy(target->magic, "TMSH", 4);
+		target->version = triangleMeshVersion;
+		target->vertexCount = vertexCount;
+		target->triangleCount = triangleCount;
+		target->nodeCount = nodeCount;
+
+		Attach(&storage[0]);
+
+		float* vertexData = const_cast<float*>(vertices);
+		for (unsigned i = 0; i < vertexCount; i++)
+		{
+			vertexData[3 * i] = (float)points[i].x;
+			vertexData[3 * i + 1] = (float)points[i].y;
+			vertexData[3 * i + 2] = (float)points[i].z;
+		}
+
+		if (triangleCount) memcpy(const_cast<unsigned*>(indices), &triangles[0], (size_t)triangleCount * 3 * sizeof(unsigned));
+
+		// Bounds of the stored floats, so that the quantized boxes are conservative for them
+		for (unsigned k = 0; k < 3; k++)
+		{
+			target->boundsMin[k] = target->boundsMax[k] = vertexCount ? vertexData[k] : 0;
+		}
+		for (unsigned i = 1; i < vertexCount; i++)
+		{
+			for (unsigned k = 0; k < 3; k++)
+			{
+				target->boundsMin[k] = std::min(target->boundsMin[k], vertexData[3 * i + k]);
+				target->boundsMax[k] = std::max(target->boundsMax[k], vertexData[3 * i + k]);
+			}
+		}
+		for (unsigned k = 0; k < 3; k++)
+		{
+			float extent = std::max(target->boundsMax[k] - target->boundsMin[k], minQuantizedExtent);
+			target->quantization[k] = 65535.0f / extent;
+		}
+
+		if (!triangleCount) return;
+
+		FindActiveEdges();
+
+		std::vector<Vector3> centroids(triangleCount);
+		std::vector<QuantizedNode> leaves(triangleCount);
+		std::vector<unsigned> order(triangleCount);
+
+		for (unsigned t = 0; t < triangleCount; t++)
+		{
+			Vector3 a, b, c;
+			GetTriangle(t, a, b, c);
+
+			Vector3 low(std::min(a.x, std::min(b.x, c.x)), std::min(a.y, std::min(b.y, c.y)), std::min(a.z, std::min(b.z, c.z)));
+			Vector3 high(std::max(a.x, std::max(b.x, c.x)), std::max(a.y, std::max(b.y, c.y)), std::max(a.z, std::max(b.z, c.z)));
+
+			Quantize(low, false, leaves[t].min);
+			Quantize(high, true, leaves[t].max);
+			leaves[t].index = (int)t;
+
+			centroids[t] = (a + b + c) * ((real)1 / 3);
+			order[t] = t;
+		}
+
+		unsigned next = 0;
+		BuildNode(order, 0, triangleCount, centroids, leaves, const_cast<QuantizedNode*>(nodes), next);
+	}
+
+	// Maps a file written by Save. Returns false, leaving the mesh empty, when the file cannot be
+	// opened, is not a mesh file of this version, or is truncated or corrupt such that a query could
+	// read outside it. The check is one pass over the indices and nodes and allocates nothing.
+	bool Load(const char* path)
+	{
+		storage.clear();
+		header = NULL;
+		vertices = NULL;
+		indices = NULL;
+		nodes = NULL;
+		edgeFlags = NULL;
+
+		if (!file.Open(path)) return false;
+
+		const TriangleMeshHeader* mapped = static_cast<const TriangleMeshHeader*>(file.GetData());
+
+		if (file.GetSize() < sizeof(TriangleMeshHeader) ||
+			memcmp(mapped->magic, "TMSH", 4) != 0 ||
+			mapped->version != triangleMeshVersion ||
+			file.GetSize() < GetFileSize(mapped->vertexCount, mapped->triangleCount, mapped->nodeCount))
+		{
+			file.Close();
+			return false;
+		}
+
+		Attach(file.GetData());
+
+		if (!IsValid())
+		{
+			header = NULL;
+			vertices = NULL;
+			indices = NULL;
+			nodes = NULL;
+			edgeFlags = NULL;
+
+			file.Close();
+			return false;
+		}
+
+		return true;
+	}
+
+	bool Save(const char* path) const
+	{
+		if (!header) return false;
+
+		FILE* out = fopen(path, "wb");
+		if (!out) return false;
+
+		size_t size = (size_t)GetFileSize(header->vertexCount, header->triangleCount, header->nodeCount);
+		bool written = fwrite(header, 1, size, out) == size;
+
+		return fclose(out) == 0 && written;
+	}
+
+	unsigned GetTriangleCount() const
+	{
+		return header ? header->triangleCount : 0;
+	}
+
+	void GetTriangle(unsigned index, Vector3& a, Vector3& b, Vector3& c) const
+	{
+		const unsigned* triangle = indices + 3 * index;
+		const float* v;
+
+		v = vertices + 3 * triangle[0];
+		a = Vector3(v[0], v[1], v[2]);
+		v = vertices + 3 * triangle[1];
+		b = Vector3(v[0], v[1], v[2]);
+		v = vertices + 3 * triangle[2];
+		c = Vector3(v[0], v[1], v[2]);
+	}
+
+	// Bit j is set when edge j, from vertex j to vertex j + 1, is on the boundary or a convex crease
+	unsigned GetActiveEdges(unsigned index) const
+	{
+		return edgeFlags[index];
+	}
+
+	// Bounds of all vertices in the mesh's space
+	AABB GetBounds() const
+	{
+		if (!header) return AABB();
+
+		return AABB(
+			Vector3(header->boundsMin[0], header->boundsMin[1], header->boundsMin[2]),
+			Vector3(header->boundsMax[0], header->boundsMax[1], header->boundsMax[2]));
+	}
+
+	// Adds the triangles whose quantized bounds overlap the box, given in the mesh's space, to hits
+	void Query(const AABB& box, std::vector<unsigned>& hits) const
+	{
+		if (!header || !header->nodeCount || !box.Overlaps(GetBounds())) return;
+
+		unsigned short low[3], high[3];
+		Quantize(box.min, false, low);
+		Quantize(box.max, true, high);
+
+		unsigned count = header->nodeCount;
+		unsigned i = 0;
+
+		while (i < count)
+		{
+			const QuantizedNode& node = nodes[i];
+
+			bool overlaps =
+				node.min[0] <= high[0] && node.max[0] >= low[0] &&
+				node.min[1] <= high[1] && node.max[1] >= low[1] &&
+				node.min[2] <= high[2] && node.max[2] >= low[2];
+
+			if (node.index >= 0)
+			{
+				if (overlaps) hits.push_back((unsigned)node.index);
+				i++;
+			}
+			else
+			{
+				i += overlaps ? 1 : (unsigned)-node.index;
+			}
+		}
+	}
+
+	// Closest triangle hit by a ray in the mesh's space within maxDistance. The ray is scaled into the
+	// quantized space, where the distances along it stay the same, so every node costs one slab test.
+	bool Raycast(const Vector3& origin, const Vector3& direction, real maxDistance, real& distance, unsigned& triangle) const
+	{
+		if (!header || !header->nodeCount) return false;
+
+		Vector3 quantizedOrigin, quantizedDirection;
+		for (unsigned k = 0; k < 3; k++)
+		{
+			quantizedOrigin[k] = (origin[k] - header->boundsMin[k]) * header->quantization[k];
+			quantizedDirection[k] = direction[k] * header->quantization[k];
+
+			// Keeps the reciprocal finite for rays parallel to the slab, keeping the sign
+			if (real_abs(quantizedDirection[k]) < (real)1e-30) quantizedDirection[k] = quantizedDirection[k] < 0 ? (real)-1e-30 : (real)1e-30;
+		}
+		Vector3 inverse(1 / quantizedDirection.x, 1 / quantizedDirection.y, 1 / quantizedDirection.z);
+
+		bool found = false;
+		unsigned count = header->nodeCount;
+		unsigned i = 0;
+
+		while (i < count)
+		{
+			const QuantizedNode& node = nodes[i];
+
+			AABB box(
+				Vector3(node.min[0], node.min[1], node.min[2]),
+				Vector3(node.max[0], node.max[1], node.max[2]));
+
+			real entry;
+			bool overlaps = rayIntersectsBox(quantizedOrigin, inverse, maxDistance, box, entry);
+
+			if (node.index >= 0)
+			{
+				if (overlaps)
+				{
+					Vector3 a, b, c;
+					real t;
+
+					GetTriangle((unsigned)node.index, a, b, c);
+					if (rayIntersectsTriangle(origin, direction, maxDistance, a, b, c, t))
+					{
+						maxDistance = t;
+						distance = t;
+						triangle = (unsigned)node.index;
+						found = true;
+					}
+				}
+				i++;
+			}
+			else
+			{
+				i += overlaps ? 1 : (unsigned)-node.index;
+			}
+		}
+
+		return found;
+	}
+};
@@ -0,0 +1,418 @@
+#pragma once
+#include "Broadphase.h"
+#include <math.h>
+#include <stdlib.h>
+#include <limits.h>
+
+
+// Hashed uniform grid for scenes made of many similarly sized colliders, e.g. spheres.
+// The cell lists are rebuilt every step with a counting sort into flat arrays, so after the first
+// steps no memory is allocated. Colliders larger than a cell are kept aside and tested against all.
+class UniformGridBroadphase : public Broadphase
+{
+	real cellSize;
+
+	std::vector<Collider*> colliders;
+
+	// Per collider, three integer cell coordinates and the hash bucket of that cell
+	std::vector<int> cells;
+	std::vector<unsigned> buckets;
+
+	// Collider indices sorted by bucket, bucket b owns sorted[bucketStart[b] .. bucketStart[b + 1])
+	std::vector<unsigned> bucketStart;
+	std::vector<unsigned> bucketFill;
+	std::vector<unsigned> sorted;
+
+	std::vector<unsigned> large;
+
+	// Lowest and highest cell coordinates holding a small collider, per axis
+	int occupiedLow[3];
+	int occupiedHigh[3];
+
+	unsigned bucketCount = 0;
+
+	// Set while colliders were added or removed or the cell size changed since the cells were last sorted
+	bool stale = true;
+
+	unsigned Hash(int x, int y, int z) const
+	{
+		unsigned h = ((unsigned)x * 73856093u) ^ ((unsigned)y * 19349663u) ^ ((unsigned)z * 83492791u);
+		return h & (bucketCount - 1);
+	}
+
+	// Cell of a coordinate already divided by the cell size. Clamped so that colliders far from the
+	// origin share the outermost cells instead of overflowing the cast.
+	static int CellCoordinate(real scaled)
+	{
+		const real limit = (real)(1 << 29);
+		return (int)floor(std::max(-limit, std::min(limit, scaled)));
+	}
+
+	bool IsLarge(unsigned index) const
+	{
+		return buckets[index] == bucketCount;
+	}
+
+	// Hands the colliders of one cell that are within maxDistance to the callback, returns how many
+	// colliders the cell holds
+	unsigned VisitNearest(int x, int y, int z, const Vector3& point, real& maxDistance, NearestCallback& callback)
+	{
+		unsigned bucket = Hash(x, y, z);
+		unsigned count = 0;
+
+		for (unsigned k = bucketStart[bucket]; k < bucketStart[bucket + 1]; k++)
+		{
+			unsigned j = sorted[k];
+
+			const int* cell = &cells[3 * j];
+			if (cell[0] != x || cell[1] != y || cell[2] != z) continue;
+
+			count++;
+			if (distanceToBox(point, colliders[j]->GetBoundingBox()) <= maxDistance)
+			{
+				maxDistance = callback.ReportCollider(colliders[j], maxDistance);
+			}
+		}
+
+		return count;
+	}
+
+	// Number of cells within ring cells of the centre on every axis that lie inside the occupied bounds
+	unsigned CountCells(const int* centre, int ring) const
+	{
+		if (ring < 0) return 0;
+
+		unsigned count = 1;
+		for (unsigned k = 0; k < 3; k++)
+		{
+			int low = std::max(-ring, occupiedLow[k] - centre[k]);
+			int high = std::min(ring, occupiedHigh[k] - centre[k]);
+			if (high < low) return 0;
+
+			count *= (unsigned)(high - low + 1);
+		}
+
+		return count;
+	}
+
+public:
+
+	UniformGridBroadphase(real cellSize = 1) : cellSize(cellSize)
+	{
+		for (unsigned k = 0; k < 3; k++)
+		{
+			occupiedLow[k] = 0;
+			occupiedHigh[k] = -1;
+		}
+	}
+
+	void SetCellSize(real cellSize)
+	{
+		this->cellSize = cellSize;
+		stale = true;
+	}
+
+	real GetCellSize() const
+	{
+		return cellSize;
+	}
+
+	void Add(Collider* collider)
+	{
+		collider->broadphaseProxy = 0;
+		colliders.push_back(collider);
+		stale = true;
+	}
+
+	void Remove(Collider* collider)
+	{
+		std::vector<Collider*>::iterator it = std::find(colliders.begin(), colliders.end(), collider);
+		if (it == colliders.end()) return;
+
+		colliders.erase(it);
+		collider->broadphaseProxy = -1;
+		stale = true;
+	}
+
+	void Update()
+	{
+		unsigned n = (unsigned)colliders.size();
+
+		bucketCount = 64;
+		while (bucketCount < 2 * n) bucketCount <<= 1;
+
+		cells.resize(3 * n);
+		buckets.resize(n);
+		sorted.resize(n);
+		bucketStart.assign(bucketCount + 1, 0);
+		large.clear();
+
+		real inverseCellSize = (real)1 / cellSize;
+		real halfCell = cellSize * (real)0.5;
+
+		for (unsigned k = 0; k < 3; k++)
+		{
+			occupiedLow[k] = INT_MAX;
+			occupiedHigh[k] = INT_MIN;
+		}
+
+		for (unsigned i = 0; i < n; i++)
+		{
+			const AABB& box = colliders[i]->GetBoundingBox();
+			Vector3 center = box.GetCenter();
+			Vector3 half = box.GetHalfSize();
+
+			if (half.x > halfCell || half.y > halfCell || half.z > halfCell)
+			{
+				buckets[i] = bucketCount;
+				large.push_back(i);
+				continue;
+			}
+
+			int* cell = &cells[3 * i];
+			cell[0] = CellCoordinate(center.x * inverseCellSize);
+			cell[1] = CellCoordinate(center.y * inverseCellSize);
+			cell[2] = CellCoordinate(center.z * inverseCellSize);
+
+			for (unsigned k = 0; k < 3; k++)
+			{
+				occupiedLow[k] = std::min(occupiedLow[k], cell[k]);
+				occupiedHigh[k] = std::max(occupiedHigh[k], cell[k]);
+			}
+
+			buckets[i] = Hash(cell[0], cell[1], cell[2]);
+			bucketStart[buckets[i] + 1]++;
+		}
+
+		for (unsigned b = 0; b < bucketCount; b++)
+		{
+			bucketStart[b + 1] += bucketStart[b];
+		}
+
+		bucketFill.assign(bucketStart.begin(), bucketStart.end());
+
+		for (unsigned i = 0; i < n; i++)
+		{
+			if (IsLarge(i)) continue;
+			sorted[bucketFill[buckets[i]]++] = i;
+		}
+
+		stale = false;
+	}
+
+	void FindPairs(std::vector<ColliderPair>& pairs)
+	{
+		unsigned n = (unsigned)colliders.size();
+
+		for (unsigned i = 0; i < n; i++)
+		{
+			if (IsLarge(i)) continue;
+
+			const int* cell = &cells[3 * i];
+			const AABB& box = colliders[i]->GetBoundingBox();
+
+			// Neighbouring cells can hash to the same bucket, visit each bucket once
+			unsigned visited[27];
+			unsigned visitedCount = 0;
+
+			for (int dx = -1; dx <= 1; dx++)
+			for (int dy = -1; dy <= 1; dy++)
+			for (int dz = -1; dz <= 1; dz++)
+			{
+				unsigned bucket = Hash(cell[0] + dx, cell[1] + dy, cell[2] + dz);
+
+				bool seen = false;
+				for (unsigned k = 0; k < visitedCount; k++)
+				{
+					if (visited[k] == bucket) { seen = true; break; }
+				}
+				if (seen) continue;
+				visited[visitedCount++] = bucket;
+
+				for (unsigned k = bucketStart[bucket]; k < bucketStart[bucket + 1]; k++)
+				{
+					unsigned j = sorted[k];
+					if (j <= i) continue;
+
+					if (box.Overlaps(colliders[j]->GetBoundingBox()))
+					{
+						AddPair(pairs, colliders[i], colliders[j]);
+					}
+				}
+			}
+		}
+
+		for (unsigned l = 0; l < large.size(); l++)
+		{
+			unsigned i = large[l];
+			const AABB& box = colliders[i]->GetBoundingBox();
+
+			for (unsigned j = 0; j < n; j++)
+			{
+				if (j == i || (IsLarge(j) && j < i)) continue;
+
+				if (box.Overlaps(colliders[j]->GetBoundingBox()))
+				{
+					AddPair(pairs, colliders[i], colliders[j]);
+				}
+			}
+		}
+	}
+
+	// The buckets are hashed so a ray cannot walk the cells in order, a plain slab test is used instead
+	real QueryRay(const Ray& ray, RayQueryCallback& callback)
+	{
+		return QueryRayList(colliders, ray, callback);
+	}
+
+	// A small collider sits in the bucket of the cell holding its centre, which is at most half a cell
+	// outside any box it overlaps, so only those cells are visited. Boxes covering more cells than there
+	// are colliders, and queries made before the cells caught up with added or removed colliders, test
+	// every collider instead.
+	bool Query(const AABB& box, OverlapCallback& callback)
+	{
+		if (stale) return QueryList(colliders, box, callback);
+
+		real inverseCellSize = (real)1 / cellSize;
+		real halfCell = cellSize * (real)0.5;
+
+		int low[3] = { 0, 0, 0 };
+		int high[3] = { 0, 0, 0 };
+		real cellCount = 1;
+		for (unsigned k = 0; k < 3; k++)
+		{
+			low[k] = CellCoordinate((box.min[k] - halfCell) * inverseCellSize);
+			high[k] = CellCoordinate((box.max[k] + halfCell) * inverseCellSize);
+			cellCount *= (real)high[k] - low[k] + 1;
+		}
+
+		if (!(cellCount <= colliders.size())) return QueryList(colliders, box, callback);
+
+		for (int x = low[0]; x <= high[0]; x++)
+		for (int y = low[1]; y <= high[1]; y++)
+		for (int z = low[2]; z <= high[2]; z++)
+		{
+			unsigned bucket = Hash(x, y, z);
+
+			for (unsigned k = bucketStart[bucket]; k < bucketStart[bucket + 1]; k++)
+			{
+				unsigned j = sorted[k];
+
+				// Other cells of the same bucket are visited on their own
+				const int* cell = &cells[3 * j];
+				if (cell[0] != x || cell[1] != y || cell[2] != z) continue;
+
+				if (colliders[j]->GetBoundingBox().Overlaps(box) && !callback.ReportCollider(colliders[j])) return false;
+			}
+		}
+
+		for (unsigned l = 0; l < large.size(); l++)
+		{
+			Collider* collider = colliders[large[l]];
+			if (collider->GetBoundingBox().Overlaps(box) && !callback.ReportCollider(collider)) return false;
+		}
+
+		return true;
+	}
+
+	// Walks the cells in rings of growing size around the point's cell, clipped to the cells that hold
+	// colliders. A small collider is at most half a cell outside the cell holding its centre, so the
+	// walk stops at the first ring whose nearest possible collider is farther than maxDistance. Once
+	// the rings would visit more cells than there are colliders, the colliders outside the walked
+	// rings are tested directly instead.
+	real QueryNearest(const Vector3& point, real maxDistance, NearestCallback& callback)
+	{
+		if (stale) return QueryNearestList(colliders, point, maxDistance, callback);
+
+		for (unsigned l = 0; l < large.size(); l++)
+		{
+			Collider* collider = colliders[large[l]];
+			if (distanceToBox(point, collider->GetBoundingBox()) <= maxDistance)
+			{
+				maxDistance = callback.ReportCollider(collider, maxDistance);
+			}
+		}
+
+		real inverseCellSize = (real)1 / cellSize;
+		real halfCell = cellSize * (real)0.5;
+
+		// The point's cell and its distance to the nearest face of that cell
+		int centre[3] = { 0, 0, 0 };
+		real inner = cellSize;
+		for (unsigned k = 0; k < 3; k++)
+		{
+			real scaled = point[k] * inverseCellSize;
+			centre[k] = CellCoordinate(scaled);
+
+			real fraction = scaled - floor(scaled);
+			inner = floor(scaled) == centre[k] ? std::min(inner, std::min(fraction, 1 - fraction) * cellSize) : 0;
+		}
+
+		unsigned smallCount = (unsigned)(colliders.size() - large.size());
+		if (smallCount == 0) return maxDistance;
+
+		// Rings closer than this miss the occupied cells entirely
+		int first = 0;
+		for (unsigned k = 0; k < 3; k++)
+		{
+			first = std::max(first, std::max(occupiedLow[k] - centre[k], centre[k] - occupiedHigh[k]));
+		}
+
+		unsigned visited = 0;
+		unsigned cellsVisited = 0;
+
+		for (int ring = first; visited < smallCount; ring++)
+		{
+			if ((ring - 1) * cellSize + inner - halfCell > maxDistance) break;
+
+			unsigned ringCells = CountCells(centre, ring) - CountCells(centre, ring - 1);
+
+			if (cellsVisited + ringCells > colliders.size())
+			{
+				for (unsigned i = 0; i < colliders.size(); i++)
+				{
+					if (IsLarge(i)) continue;
+
+					const int* cell = &cells[3 * i];
+					int reach = std::max(abs(cell[0] - centre[0]), std::max(abs(cell[1] - centre[1]), abs(cell[2] - centre[2])));
+					if (reach < ring) continue;
+
+					if (distanceToBox(point, colliders[i]->GetBoundingBox()) <= maxDistance)
+					{
+						maxDistance = callback.ReportCollider(colliders[i], maxDistance);
+					}
+				}
+				break;
+			}
+			cellsVisited += ringCells;
+
+			int low[3] = { 0, 0, 0 };
+			int high[3] = { 0, 0, 0 };
+			for (unsigned k = 0; k < 3; k++)
+			{
+				low[k] = std::max(-ring, occupiedLow[k] - centre[k]);
+				high[k] = std::min(ring, occupiedHigh[k] - centre[k]);
+			}
+
+			for (int x = low[0]; x <= high[0]; x++)
+			for (int y = low[1]; y <= high[1]; y++)
+			{
+				// Away from the ring's x and y faces only its two z faces belong to it
+				if (x == -ring || x == ring || y == -ring || y == ring)
+				{
+					for (int z = low[2]; z <= high[2]; z++)
+					{
+						visited += VisitNearest(centre[0] + x, centre[1] + y, centre[2] + z, point, maxDistance, callback);
+					}
+				}
+				else
+				{
+					if (low[2] == -ring) visited += VisitNearest(centre[0] + x, centre[1] + y, centre[2] - ring, point, maxDistance, callback);
+					if (high[2] == ring) visited += VisitNearest(centre[0] + x, centre[1] + y, centre[2] + ring, point, maxDistance, callback);
+				}
+			}
+		}
+
+		return maxDistance;
+	}
+};
@@ -3,54 +3,1022 @@
 #include "Contact.h"
 #include "CollisionDetector.h"
 #include "Colliders.h"
+#include "Broadphase.h"
+#include "SweepAndPrune.h"
+#include "DynamicTreeBroadphase.h"
+#include "UniformGrid.h"
+#include "PairCache.h"
+
+// Most impacts a swept body is stopped at in one step, whatever is left of its motion is dropped
+#define maxSweepSteps 4
+
+// How far past the impact a swept body is placed, relative to its size, so that the narrowphase
+// reports the contact
+#define sweepPenetration ((real)0.05)
 
 class World
 {
+	Broadphase* broadphase;
+	BroadphaseType broadphaseType;
+
+	real gridCellSize = 1;
+
+	// Set when contacts moved colliders after the broadphase last read their bounds
+	bool broadphaseStale = false;
+
+	// Next id handed to a collider the world has not seen before
+	unsigned nextColliderId = 0;
+
+	std::vector<ColliderState> colliderStates;
+
+	// Colliders of the list grouped by their body as pairs of body and collider index, so that
+	// resolving a contact can place every collider of the bodies it moved. bodyIndexed holds the
+	// body each collider had when the index was built, any difference rebuilds it.
+	std::vector<std::pair<RigidBody*, unsigned>> bodyColliders;
+	std::vector<RigidBody*> bodyIndexed;
+	std::vector<ColliderPair> pairs;
+	PairCache pairCache;
+	CollisionFilter filter;
+	ContactBuffer contacts;
+
+	DynamicAABBTree staticTree;
+	unsigned staticTreeSize = 0;
+
+	// Set by AddStaticCollider, RemoveCollider and MarkStaticCollidersChanged, the static tree is
+	// rebuilt before the next step or query that reads it
+	bool staticTreeDirty = true;
+	std::vector<int> staticHits;
+
+	// Order in which RaycastMany casts its rays, pairs of Morton code and ray index
+	std::vector<std::pair<unsigned, unsigned>> rayOrder;
+
+	// Probe and contact storage of the exact overlap tests, reused by every query
+	SphereCollider querySphere;
+	ContactBuffer queryContacts;
+
+	// Bodies flagged for continuous collision with the position they started the step at, and the
+	// shapes of those bodies that are swept, each with the collider of the list it belongs to: itself,
+	// or the compound of a child
+	std::vector<std::pair<RigidBody*, Vector3>> sweptBodies;
+	std::vector<std::pair<Collider*, Collider*>> sweptColliders;
+
+	Broadphase* CreateBroadphase(BroadphaseType type)
+	{
+		Broadphase* created;
+
+		switch (type)
+		{
+		case BroadphaseType::BruteForce:
+			created = new BruteForceBroadphase();
+			break;
+		case BroadphaseType::DynamicTree:
+			created = new DynamicTreeBroadphase();
+			break;
+		case BroadphaseType::UniformGrid:
+			created = new UniformGridBroadphase(gridCellSize);
+			break;
+		default:
+			created = new SweepAndPruneBroadphase();
+			break;
+		}
+
+		created->SetFilter(&filter);
+		return created;
+	}
+
+	void BuildStaticTree()
+	{
+		staticTree = DynamicAABBTree((real)0);
+
+		for (int i = 0; i < staticColliders.size(); i++)
+		{
+			AssignId(staticColliders[i]);
+			staticColliders[i]->calculateInternals();
+			staticColliders[i]->broadphaseProxy = staticTree.CreateProxy(staticColliders[i]->GetBoundingBox(), staticColliders[i]);
+		}
+
+		staticTreeSize = (unsigned)staticColliders.size();
+		staticTreeDirty = false;
+	}
+
+	void PrepareStaticTree()
+	{
+		// Static colliders pushed or erased directly without MarkStaticCollidersChanged
+		assert(staticTreeDirty || staticColliders.size() == staticTreeSize);
+
+		if (staticTreeDirty)
+		{
+			BuildStaticTree();
+		}
+	}
+
+	void AssignId(Collider* collider)
+	{
+		if (collider->id == 0xffffffff) collider->id = nextColliderId++;
+	}
+
+	static bool IsImmovable(const Collider* collider)
+	{
+		return !collider->rigidBody || collider->rigidBody->GetInverseMass() == 0;
+	}
+
+	void RefreshBody(RigidBody* body)
+	{
+		std::vector<std::pair<RigidBody*, unsigned>>::iterator it =
+			std::lower_bound(bodyColliders.begin(), bodyColliders.end(), std::make_pair(body, 0u));
+
+		for (; it != bodyColliders.end() && it->first == body; ++it)
+		{
+			colliders[it->second]->calculateInternals();
+		}
+	}
+
+	// Resolving contacts moves bodies after their colliders were placed for the step, place every
+	// collider of the bodies of a resolved pair again so later pairs and queries see where they ended up
+	void RefreshColliders(Collider* one, Collider* two)
+	{
+		if (!IsImmovable(one)) RefreshBody(one->rigidBody);
+		if (two && !IsImmovable(two) && two->rigidBody != one->rigidBody) RefreshBody(two->rigidBody);
+
+		broadphaseStale = true;
+	}
+
+	// Brings the structures the queries search up to date: the static tree after static colliders
+	// changed, and the broadphase after contacts moved colliders since its last update
+	void PrepareQueries()
+	{
+		PrepareStaticTree();
+
+		if (broadphaseStale)
+		{
+			broadphase->Update();
+			broadphaseStale = false;
+		}
+	}
+
+	// Drops dynamic pairs that cannot respond to a contact, and adds the dynamic against static pairs
+	void FindStaticPairs()
+	{
+		unsigned kept = 0;
+		for (unsigned i = 0; i < pairs.size(); i++)
+		{
+			if (IsImmovable(pairs[i].one) && IsImmovable(pairs[i].two)) continue;
+			pairs[kept++] = pairs[i];
+		}
+		pairs.resize(kept);
+
+		PrepareStaticTree();
+
+		if (staticTreeSize == 0) return;
+
+		for (int i = 0; i < colliders.size(); i++)
+		{
+			if (IsImmovable(colliders[i])) continue;
+
+			const AABB& box = colliders[i]->GetBoundingBox();
+
+			staticHits.clear();
+			staticTree.Query(box, staticHits);
+
+			for (unsigned j = 0; j < staticHits.size(); j++)
+			{
+				Collider* other = static_cast<Collider*>(staticTree.GetUserData(staticHits[j]));
+
+				if (filter.ShouldCollide(colliders[i], other))
+				{
+					pairs.push_back(ColliderPair(colliders[i], other));
+				}
+			}
+		}
+	}
+
+	// Keeps the closest hit, every hit shortens the ray for the colliders still to come
+	class ClosestRayHit : public RayQueryCallback
+	{
+		const Ray& ray;
+
+	public:
+
+		RaycastHit hit;
+		bool found;
+
+		ClosestRayHit(const Ray& ray) : ray(ray), found(false)
+		{
+
+		}
+
+		real ReportCollider(Collider* collider, real maxDistance)
+		{
+			if (!(collider->collisionGroup & ray.mask)) return maxDistance;
+
+			Ray clipped = ray;
+			clipped.maxDistance = maxDistance;
+
+			if (!CollisionDetector::Raycast(collider, clipped, hit)) return maxDistance;
+
+			found = true;
+			return hit.distance;
+		}
+	};
+
+	class AllRayHits : public RayQueryCallback
+	{
+		const Ray& ray;
+		std::vector<RaycastHit>& hits;
+
+	public:
+
+		AllRayHits(const Ray& ray, std::vector<RaycastHit>& hits) : ray(ray), hits(hits)
+		{
+
+		}
+
+		real ReportCollider(Collider* collider, real maxDistance)
+		{
+			if (!(collider->collisionGroup & ray.mask)) return maxDistance;
+
+			RaycastHit hit;
+			if (CollisionDetector::Raycast(collider, ray, hit)) hits.push_back(hit);
+
+			return maxDistance;
+		}
+	};
+
+	// Closest hit of a swept shape, which never hits itself
+	class ClosestShapeHit : public RayQueryCallback
+	{
+		Collider* shape;
+		const Vector3& direction;
+		unsigned mask;
+
+	public:
+
+		RaycastHit hit;
+		bool found;
+
+		ClosestShapeHit(Collider* shape, const Vector3& direction, unsigned mask) : shape(shape), direction(direction), mask(mask), found(false)
+		{
+
+		}
+
+		real ReportCollider(Collider* collider, real maxDistance)
+		{
+			if (collider == shape || !(collider->collisionGroup & mask)) return maxDistance;
+
+			if (!CollisionDetector::ShapeCast(shape, direction, maxDistance, collider, hit)) return maxDistance;
+
+			found = true;
+			return hit.distance;
+		}
+	};
+
+	// Earliest impact of a collider swept with its body. Skips the body's other colliders and the pairs
+	// the filter rejects for owner, the collider of the list the shape belongs to. Colliders it already
+	// touches are left to the discrete contacts, which have removed the closing velocity against them.
+	class SweepHit : public RayQueryCallback
+	{
+		Collider* shape;
+		Collider* owner;
+		const Vector3& direction;
+		const CollisionFilter& filter;
+
+	public:
+
+		RaycastHit hit;
+		bool found;
+
+		SweepHit(Collider* shape, Collider* owner, const Vector3& direction, const CollisionFilter& filter) :
+			shape(shape), owner(owner), direction(direction), filter(filter), found(false)
+		{
+
+		}
+
+		real ReportCollider(Collider* collider, real maxDistance)
+		{
+			if (collider->rigidBody == shape->rigidBody || !filter.ShouldCollide(owner, collider)) return maxDistance;
+
+			RaycastHit candidate;
+			if (!CollisionDetector::ShapeCast(shape, direction, maxDistance, collider, candidate)) return maxDistance;
+			if (candidate.distance <= 0) return maxDistance;
+
+			hit = candidate;
+			found = true;
+			return hit.distance;
+		}
+	};
+
+	// Writes the colliders that pass the mask and the exact test into the caller's buffer, stops when it is full
+	class OverlapList : public OverlapCallback
+	{
+		const AABB& box;
+		Collider* shape;
+		ContactBuffer& contacts;
+		unsigned mask;
+		Collider** results;
+		unsigned capacity;
+
+	public:
+
+		unsigned count;
+
+		OverlapList(const AABB& box, Collider* shape, ContactBuffer& contacts, unsigned mask, Collider** results, unsigned capacity)
+			: box(box), shape(shape), contacts(contacts), mask(mask), results(results), capacity(capacity), count(0)
+		{
+
+		}
+
+		bool ReportCollider(Collider* collider)
+		{
+			if (!(collider->collisionGroup & mask)) return true;
+
+			if (collider->colliderType == ColliderType::HalfSpace)
+			{
+				if (!static_cast<HalfSpaceCollider*>(collider)->Overlaps(box)) return true;
+			}
+			else if (!collider->GetBoundingBox().Overlaps(box))
+			{
+				return true;
+			}
+
+			if (shape)
+			{
+				contacts.Reset();
+				if (CollisionDetector::DetectCollision(shape, collider, contacts) == 0) return true;
+			}
+
+			results[count++] = collider;
+			return count < capacity;
+		}
+	};
+
+	// Keeps the caller's buffers sorted by distance, the farthest entry drops out when a nearer one arrives
+	class NearestList : public NearestCallback
+	{
+		const Vector3& point;
+		unsigned mask;
+		Collider** results;
+		real* distances;
+		unsigned capacity;
+
+	public:
+
+		unsigned count;
+
+		NearestList(const Vector3& point, unsigned mask, Collider** results, real* distances, unsigned capacity)
+			: point(point), mask(mask), results(results), distances(distances), capacity(capacity), count(0)
+		{
+
+		}
+
+		real ReportCollider(Collider* collider, real maxDistance)
+		{
+			if (!(collider->collisionGroup & mask)) return maxDistance;
+
+			real distance;
+			if (collider->colliderType == ColliderType::HalfSpace)
+			{
+				HalfSpaceCollider* plane = static_cast<HalfSpaceCollider*>(collider);
+				distance = std::max((real)0, plane->GetWorldNormal() * point - plane->GetWorldDistance());
+			}
+			else
+			{
+				distance = distanceToBox(point, collider->GetBoundingBox());
+			}
+
+			if (distance > maxDistance) return maxDistance;
+
+			unsigned slot = count < capacity ? count++ : capacity - 1;
+			while (slot > 0 && distances[slot - 1] > distance)
+			{
+				results[slot] = results[slot - 1];
+				distances[slot] = distances[slot - 1];
+				slot--;
+			}
+			results[slot] = collider;
+			distances[slot] = distance;
+
+			return count == capacity ? distances[count - 1] : maxDistance;
+		}
+	};
+
+	static bool CompareHits(const RaycastHit& a, const RaycastHit& b)
+	{
+		return a.distance < b.distance;
+	}
+
+	// Morton code of a point's cell in a 1024 cells wide grid over the bounds, nearby points get
+	// nearby codes
+	static unsigned MortonCode(const Vector3& point, const AABB& bounds)
+	{
+		unsigned code = 0;
+
+		for (unsigned k = 0; k < 3; k++)
+		{
+			real extent = bounds.max[k] - bounds.min[k];
+			real scaled = extent > 0 ? (point[k] - bounds.min[k]) * (1023 / extent) : 0;
+			unsigned cell = (unsigned)std::max((real)0, std::min((real)1023, scaled));
+
+			// Spread the ten bits of the cell three apart
+			cell = (cell | (cell << 16)) & 0x030000FF;
+			cell = (cell | (cell << 8)) & 0x0300F00F;
+			cell = (cell | (cell << 4)) & 0x030C30C3;
+			cell = (cell | (cell << 2)) & 0x09249249;
+
+			code |= cell << k;
+		}
+
+		return code;
+	}
+
+	void PlaceSweptColliders(RigidBody* body)
+	{
+		body->CalculateDerivedData();
+
+		for (int i = 0; i < sweptColliders.size(); i++)
+		{
+			Collider* shape = sweptColliders[i].first;
+			Collider* owner = sweptColliders[i].second;
+			if (owner->rigidBody != body) continue;
+
+			owner->calculateInternals();
+			if (shape != owner) static_cast<CompoundCollider*>(owner)->PlaceChild(shape);
+		}
+	}
+
+	// Takes each flagged body that moved farther than its own size this step back to where it
+	// started and sweeps it along its velocity instead. At an impact it is placed just inside what
+	// it hit, that contact is resolved, and it carries on for the rest of the step with the velocity
+	// the contact left it. Only the translation is swept, the body keeps the orientation it was
+	// integrated to. Compounds are swept child by child, mesh and heightfield colliders are not swept.
+	// Returns whether any body was stopped at an impact.
+	bool SweepFastBodies(real duration)
+	{
+		if (sweptBodies.empty()) return false;
+
+		sweptColliders.clear();
+		for (int i = 0; i < colliders.size(); i++)
+		{
+			Collider* collider = colliders[i];
+			if (!collider->rigidBody || !collider->rigidBody->GetContinuousCollision()) continue;
+
+			if (collider->colliderType == ColliderType::Compound)
+			{
+				CompoundCollider* compound = static_cast<CompoundCollider*>(collider);
+				for (unsigned j = 0; j < compound->GetChildCount(); j++)
+				{
+					Collider* child = compound->GetChild(j);
+					if (!CollisionDetector::CanShapeCast(child->colliderType)) continue;
+
+					compound->PlaceChild(child);
+					sweptColliders.push_back(std::make_pair(child, collider));
+				}
+			}
+			else if (CollisionDetector::CanShapeCast(collider->colliderType))
+			{
+				sweptColliders.push_back(std::make_pair(collider, collider));
+			}
+		}
+
+		bool prepared = false;
+		bool stopped = false;
+
+		for (int i = 0; i < sweptBodies.size(); i++)
+		{
+			RigidBody* body = sweptBodies[i].first;
+			Vector3 start = sweptBodies[i].second;
+
+			// A body that moves less than the smallest half extent of its colliders cannot pass
+			// through anything without the discrete contacts seeing the overlap
+			real size = REAL_MAX;
+			for (int j = 0; j < sweptColliders.size(); j++)
+			{
+				if (sweptColliders[j].second->rigidBody != body) continue;
+
+				Vector3 half = sweptColliders[j].first->GetBoundingBox().GetHalfSize();
+				size = std::min(size, std::min(half.x, std::min(half.y, half.z)));
+			}
+
+			if (size == REAL_MAX || (body->GetPosition() - start).Magnitude() <= size) continue;
+
+			if (!prepared)
+			{
+				for (int j = 0; j < halfSpaces.size(); j++)
+				{
+					halfSpaces[j]->calculateInternals();
+				}
+				prepared = true;
+			}
+
+			body->SetPosition(start);
+			PlaceSweptColliders(body);
+
+			real remaining = duration;
+
+			for (unsigned step = 0; step < maxSweepSteps && remaining > 0; step++)
+			{
+				Vector3 velocity = body->GetVelocity();
+				real speed = velocity.Magnitude();
+				if (speed <= 0) break;
+
+				Vector3 direction = velocity * ((real)1 / speed);
+				real reach = speed * remaining;
+
+				// Earliest impact over the body's colliders, each cast only searches up to the last hit
+				RaycastHit hit;
+				Collider* shape = NULL;
+				for (int j = 0; j < sweptColliders.size(); j++)
+				{
+					if (sweptColliders[j].second->rigidBody != body) continue;
+
+					const AABB& box = sweptColliders[j].first->GetBoundingBox();
+					Ray ray(box.GetCenter(), direction, shape ? hit.distance : reach);
+					ray.extent = box.GetHalfSize();
+
+					SweepHit callback(sweptColliders[j].first, sweptColliders[j].second, direction, filter);
+					QueryRay(ray, callback);
+
+					if (callback.found)
+					{
+						hit = callback.hit;
+						shape = sweptColliders[j].second;
+					}
+				}
+
+				if (!shape)
+				{
+					body->SetPosition(body->GetPosition() + velocity * remaining);
+					PlaceSweptColliders(body);
+					break;
+				}
+
+				real advance = std::min(reach, hit.distance + size * sweepPenetration);
+				body->SetPosition(body->GetPosition() + direction * advance);
+				PlaceSweptColliders(body);
+				remaining -= advance / speed;
+				stopped = true;
+
+				contacts.Reset();
+				unsigned count = CollisionDetector::DetectCollision(shape, hit.collider, contacts);
+				if (count > 0)
+				{
+					Contact::ResolveContacts(&contacts[0], count, duration);
+				}
+
+				PlaceSweptColliders(body);
+				if (hit.collider->rigidBody)
+				{
+					hit.collider->calculateInternals();
+				}
+			}
+		}
+
+		return stopped;
+	}
+
+	void CollideHalfSpaces(real duration)
+	{
+		if (halfSpaces.empty()) return;
+
+		for (int i = 0; i < halfSpaces.size(); i++)
+		{
+			halfSpaces[i]->calculateInternals();
+		}
+
+		for (int i = 0; i < colliders.size(); i++)
+		{
+			if (IsImmovable(colliders[i])) continue;
+
+			for (int j = 0; j < halfSpaces.size(); j++)
+			{
+				if (!halfSpaces[j]->Overlaps(colliders[i]->GetBoundingBox())) continue;
+				if (!filter.ShouldCollide(colliders[i], halfSpaces[j])) continue;
+
+				unsigned first = contacts.Size();
+				unsigned count = CollisionDetector::DetectCollision(colliders[i], halfSpaces[j], contacts);
+
+				if (count > 0)
+				{
+					Contact::ResolveContacts(&contacts[first], count, duration);
+					RefreshColliders(colliders[i], NULL);
+				}
+			}
+		}
+	}
+
 public:
 
 	std::vector<RigidBody*> bodies;
 	std::vector<Collider*> colliders;
 
+	// Geometry that never moves. It is never tested against itself, its bounds are computed once
+	// and it is kept in a tree of its own. Add to it with AddStaticCollider and remove with
+	// RemoveCollider; after editing the list directly or moving a static collider, call
+	// MarkStaticCollidersChanged so the tree is rebuilt.
+	// A static collider may have no rigid body, its offset then places it in the world.
+	std::vector<Collider*> staticColliders;
+
+	// Unbounded planes such as floors. They never enter the broadphase, every movable collider is
+	// tested against each of them in a single pass after the pair search.
+	std::vector<HalfSpaceCollider*> halfSpaces;
+
+	World() : broadphaseType(BroadphaseType::SweepAndPrune), staticTree((real)0)
+	{
+		broadphase = CreateBroadphase(broadphaseType);
+	}
+
+	void SetBroadphase(BroadphaseType type)
+	{
+		delete broadphase;
+		broadphase = CreateBroadphase(type);
+		broadphaseType = type;
+
+		// Colliders are registered again on the next step
+		for (Collider* collider : colliders)
+		{
+			collider->broadphaseProxy = -1;
+		}
+	}
+
+	BroadphaseType GetBroadphase() const
+	{
+		return broadphaseType;
+	}
+
+	// Cell size of the uniform grid broadphase, should be about the diameter of the typical collider
+	void SetGridCellSize(real cellSize)
+	{
+		gridCellSize = cellSize;
+
+		if (broadphaseType == BroadphaseType::UniformGrid)
+		{
+			static_cast<UniformGridBroadphase*>(broadphase)->SetCellSize(cellSize);
+		}
+	}
+
+	real GetGridCellSize() const
+	{
+		return gridCellSize;
+	}
+
+	// Contacts generated by the last step
+	ContactBuffer& GetContacts()
+	{
+		return contacts;
+	}
+
+	// Group, mask and layer filtering applied while the broadphase emits its pairs
+	CollisionFilter& GetCollisionFilter()
+	{
+		return filter;
+	}
+
+	// Overlapping pairs with their persistent data, and the begin and end deltas of the last step
+	PairCache& GetPairCache()
+	{
+		return pairCache;
+	}
+
+	void AddStaticCollider(Collider* collider)
+	{
+		staticColliders.push_back(collider);
+		staticTreeDirty = true;
+	}
+
+	// Rebuilds the static tree before the next step or query, for static colliders that were
+	// moved, or added to or replaced in staticColliders directly. Colliders taken out of the list
+	// must go through RemoveCollider so no pair keeps pointing at them.
+	void MarkStaticCollidersChanged()
+	{
+		staticTreeDirty = true;
+	}
+
+	// Colliders pushed directly into the colliders list are picked up on the next step,
+	// but they must be removed through here so the broadphase forgets them
+	void RemoveCollider(Collider* collider)
+	{
+		std::vector<HalfSpaceCollider*>::iterator plane = std::find(halfSpaces.begin(), halfSpaces.end(), collider);
+		if (plane != halfSpaces.end())
+		{
+			halfSpaces.erase(plane);
+			return;
+		}
+
+		std::vector<Collider*>::iterator it = std::find(staticColliders.begin(), staticColliders.end(), collider);
+		if (it != staticColliders.end())
+		{
+			pairCache.Remove(collider);
+			staticColliders.erase(it);
+			staticTreeDirty = true;
+			return;
+		}
+
+		it = std::find(colliders.begin(), colliders.end(), collider);
+		if (it == colliders.end()) return;
+
+		broadphase->Remove(collider);
+		pairCache.Remove(collider);
+		collider->BindState(NULL);
+		colliders.erase(it);
+	}
+
+	// Computes every collider's world transform and bounding box once per step into the
+	// contiguous state cache the broadphase and narrowphase read from
+	void UpdateColliders()
+	{
+		if (colliderStates.size() != colliders.size())
+		{
+			// Detach first so no collider is left pointing into the old cache
+			for (int i = 0; i < colliders.size(); i++)
+			{
+				colliders[i]->BindState(NULL);
+			}
+
+			colliderStates.resize(colliders.size());
+		}
+
+		bool reindex = bodyIndexed.size() != colliders.size();
+		if (reindex) bodyIndexed.resize(colliders.size());
+
+		for (int i = 0; i < colliders.size(); i++)
+		{
+			colliders[i]->BindState(&colliderStates[i]);
+			colliders[i]->calculateInternals();
+
+			if (bodyIndexed[i] != colliders[i]->rigidBody)
+			{
+				bodyIndexed[i] = colliders[i]->rigidBody;
+				reindex = true;
+			}
+
+			if (colliders[i]->broadphaseProxy < 0)
+			{
+				AssignId(colliders[i]);
+				broadphase->Add(colliders[i]);
+			}
+		}
+
+		if (reindex)
+		{
+			bodyColliders.clear();
+			for (unsigned i = 0; i < colliders.size(); i++)
+			{
+				if (colliders[i]->rigidBody) bodyColliders.push_back(std::make_pair(colliders[i]->rigidBody, i));
+			}
+			std::sort(bodyColliders.begin(), bodyColliders.end());
+		}
+	}
+
+	// Hands every collider whose bounds the ray enters to the callback: moving ones through the
+	// broadphase, static ones through their tree and then the half spaces. Colliders are where the
+	// last step left them.
+	void QueryRay(Ray ray, RayQueryCallback& callback)
+	{
+		PrepareQueries();
+
+		ray.maxDistance = broadphase->QueryRay(ray, callback);
+
+		TreeRayQueryAdapter adapter(callback);
+		ray.maxDistance = staticTree.QueryRay(ray, adapter);
+
+		for (int i = 0; i < halfSpaces.size(); i++)
+		{
+			ray.maxDistance = callback.ReportCollider(halfSpaces[i], ray.maxDistance);
+		}
+	}
+
+	// Closest collider in the ray's mask that the ray hits
+	bool Raycast(const Ray& ray, RaycastHit& hit)
+	{
+		ClosestRayHit callback(ray);
+		QueryRay(ray, callback);
+
+		if (callback.found) hit = callback.hit;
+		return callback.found;
+	}
+
+	// Appends a hit for every collider in the ray's mask that the ray hits, nearest first, and
+	// returns how many were appended
+	unsigned RaycastAll(const Ray& ray, std::vector<RaycastHit>& hits)
+	{
+		size_t first = hits.size();
+
+		AllRayHits callback(ray, hits);
+		QueryRay(ray, callback);
+
+		std::sort(hits.begin() + first, hits.end(), CompareHits);
+		return (unsigned)(hits.size() - first);
+	}
+
+	// Closest hit of each ray, for large batches such as line of sight checks. hits[i] belongs to
+	// rays[i] and has no collider when the ray hits nothing. The rays are cast in the Morton order of
+	// their origins, so consecutive rays descend through the same nodes while they are still cached.
+	// Returns how many rays hit something.
+	unsigned RaycastMany(const Ray* rays, unsigned count, RaycastHit* hits)
+	{
+		if (count == 0) return 0;
+
+		AABB bounds(rays[0].origin, rays[0].origin);
+		for (unsigned i = 1; i < count; i++)
+		{
+			bounds = bounds.Merge(AABB(rays[i].origin, rays[i].origin));
+		}
+
+		rayOrder.resize(count);
+		for (unsigned i = 0; i < count; i++)
+		{
+			rayOrder[i] = std::make_pair(MortonCode(rays[i].origin, bounds), i);
+		}
+		std::sort(rayOrder.begin(), rayOrder.end());
+
+		unsigned hitCount = 0;
+		for (unsigned i = 0; i < count; i++)
+		{
+			unsigned index = rayOrder[i].second;
+
+			hits[index] = RaycastHit();
+			if (Raycast(rays[index], hits[index])) hitCount++;
+		}
+
+		return hitCount;
+	}
+
+	// Sweeps a sphere, box, capsule or hull from where it is placed along direction, which must have
+	// unit length, and returns the first collider in mask it touches within maxDistance. The hit's
+	// point is on that collider and its normal points back towards the shape. The shape need not be in
+	// the world, a shape that is does not hit itself. Its bounds swept along the direction cull the
+	// candidates through the broadphase and the static tree.
+	bool ShapeCast(Collider* shape, const Vector3& direction, real maxDistance, RaycastHit& hit, unsigned mask = 0xffffffff)
+	{
+		const AABB& box = shape->GetBoundingBox();
+
+		Ray ray(box.GetCenter(), direction, maxDistance, mask);
+		ray.extent = box.GetHalfSize();
+
+		ClosestShapeHit callback(shape, direction, mask);
+		QueryRay(ray, callback);
+
+		if (callback.found) hit = callback.hit;
+		return callback.found;
+	}
+
+	// Hands every collider whose bounds overlap the box to the callback: moving ones through the
+	// broadphase, static ones through their tree and then the half spaces, until it returns false
+	void Query(const AABB& box, OverlapCallback& callback)
+	{
+		PrepareQueries();
+
+		if (!broadphase->Query(box, callback)) return;
+
+		TreeOverlapAdapter adapter(callback);
+		if (!staticTree.Query(box, adapter)) return;
+
+		for (int i = 0; i < halfSpaces.size(); i++)
+		{
+			if (!callback.ReportCollider(halfSpaces[i])) return;
+		}
+	}
+
+	// Writes up to capacity colliders in mask whose bounding boxes overlap the box into results and
+	// returns how many were written. Nothing is allocated.
+	unsigned OverlapAABB(const AABB& box, Collider** results, unsigned capacity, unsigned mask = 0xffffffff)
+	{
+		if (capacity == 0) return 0;
+
+		OverlapList list(box, NULL, queryContacts, mask, results, capacity);
+		Query(box, list);
+
+		return list.count;
+	}
+
+	// Same for the colliders in mask whose shapes overlap the sphere, tested exactly by the narrowphase
+	unsigned OverlapSphere(const Vector3& centre, real radius, Collider** results, unsigned capacity, unsigned mask = 0xffffffff)
+	{
+		if (capacity == 0) return 0;
+
+		Matrix4 transform;
+		transform.data[3] = centre.x;
+		transform.data[7] = centre.y;
+		transform.data[11] = centre.z;
+
+		querySphere.radius = radius;
+		querySphere.rigidBody = NULL;
+		querySphere.SetTransform(transform);
+
+		OverlapList list(querySphere.GetBoundingBox(), &querySphere, queryContacts, mask, results, capacity);
+		Query(querySphere.GetBoundingBox(), list);
+
+		return list.count;
+	}
+
+	// Hands the colliders whose bounds are within maxDistance of the point to the callback, which
+	// limits the distance for the rest of the query
+	void QueryNearest(const Vector3& point, real maxDistance, NearestCallback& callback)
+	{
+		PrepareQueries();
+
+		maxDistance = broadphase->QueryNearest(point, maxDistance, callback);
+
+		TreeNearestAdapter adapter(callback);
+		maxDistance = staticTree.QueryNearest(point, maxDistance, adapter);
+
+		for (int i = 0; i < halfSpaces.size(); i++)
+		{
+			maxDistance = callback.ReportCollider(halfSpaces[i], maxDistance);
+		}
+	}
+
+	// The up to k colliders in mask whose bounding boxes are nearest to the point and within
+	// maxDistance, nearest first, with their distances. Both buffers must hold k entries. Returns how
+	// many were found. Nothing is allocated.
+	unsigned NearestColliders(const Vector3& point, unsigned k, Collider** results, real* distances, real maxDistance = REAL_MAX, unsigned mask = 0xffffffff)
+	{
+		if (k == 0) return 0;
+
+		NearestList list(point, mask, results, distances, k);
+		QueryNearest(point, maxDistance, list);
+
+		return list.count;
+	}
 
 	void RunPhysics(real duration)
 	{
+		sweptBodies.clear();
 		for (int i = 0; i < bodies.size(); i++)
 		{
+			if (bodies[i]->GetContinuousCollision() && bodies[i]->GetInverseMass() != 0)
+			{
+				sweptBodies.push_back(std::make_pair(bodies[i], bodies[i]->GetPosition()));
+			}
+
 			bodies[i]->Integrate(duration);
 		}
 
-		for (int i = 0; i < colliders.size(); i++)
+		UpdateColliders();
+
+		broadphase->Update();
+		broadphaseStale = false;
+
+		// Bodies stopped by a sweep and whatever they hit have moved since the colliders were placed
+		if (SweepFastBodies(duration))
 		{
-			for (int j = i + 1; j < colliders.size(); j++)
-			{
-				colliders[i]->calculateInternals();
-				colliders[j]->calculateInternals();
+			UpdateColliders();
+			broadphase->Update();
+		}
 
-				Contact * contact = CollisionDetector::DetectCollision(colliders[i], colliders[j]);
+		pairs.clear();
+		broadphase->FindPairs(pairs);
+		FindStaticPairs();
+		pairCache.Update(pairs);
 
-				if (contact)
-				{
-					contact->ResolveCollision(duration);
+		contacts.Reset();
+
+		std::vector<OverlappingPair>& overlapping = pairCache.GetPairs();
+		for (int i = 0; i < overlapping.size(); i++)
+		{
+			unsigned first = contacts.Size();
+			unsigned count = CollisionDetector::DetectCollision(overlapping[i].one, overlapping[i].two, contacts, overlapping[i].narrowphase);
 
-					delete contact;
+			overlapping[i].penetration = 0;
 
-				}
+			for (unsigned j = first; j < first + count; j++)
+			{
+				if (contacts[j].penetration > overlapping[i].penetration)
+					overlapping[i].penetration = contacts[j].penetration;
+			}
+
+			if (count > 0)
+			{
+				Contact::ResolveContacts(&contacts[first], count, duration);
+				RefreshColliders(overlapping[i].one, overlapping[i].two);
 			}
 		}
 
+		CollideHalfSpaces(duration);
 	}
 
 	~World()
 	{
+		delete broadphase;
+
 		for (RigidBody* body : bodies)
 		{
 			delete body;
 		}
-		
+
 		for (Collider* collider : colliders)
 		{
 			delete collider;
 		}
+
+		for (Collider* collider : staticColliders)
+		{
+			delete collider;
+		}
+
+		for (Collider* collider : halfSpaces)
+		{
+			delete collider;
+		}
 	}
 
 };
\ No newline at end of file